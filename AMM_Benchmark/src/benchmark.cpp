@@ -0,0 +1,468 @@
+#include "Model.h"
+#include "GreedyModel.h"
+#include "MultiStartGRASP.h"
+#include "SimulatedAnnealing.h"
+#include "Instrumentation.h"
+
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <thread>
+
+// Every heap allocation of the process goes through here, so AllocationCounter.cpp
+// is not part of the benchmark
+static std::atomic<uint64_t> gNumAllocations(0);
+
+void* operator new(std::size_t size)
+{
+	gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+	AMM_COUNT(Allocations, 1);
+	AMM_COUNT(AllocatedBytes, size);
+	if (void* ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+struct IterationStats
+{
+	double constructiveTime = 0.0;
+	double localSearchTime = 0.0;
+	uint64_t constructiveAllocs = 0;
+	uint64_t localSearchAllocs = 0;
+	float cost = 0.0f;
+};
+
+// Runs the GRASP iterations from the same seed and returns the totals
+static IterationStats runGRASP(GreedyModel& pMod, int iterations)
+{
+	IterationStats stats;
+	pMod.setSeed(0);
+	for (int i = 0; i < iterations; ++i) {
+		pMod.purge();
+
+		uint64_t allocs = gNumAllocations.load();
+		auto start = std::chrono::steady_clock::now();
+		pMod.GRASPConstructivePhase(0.2f);
+		auto end = std::chrono::steady_clock::now();
+		stats.constructiveTime += std::chrono::duration<double>(end - start).count();
+		stats.constructiveAllocs += gNumAllocations.load() - allocs;
+
+		allocs = gNumAllocations.load();
+		start = std::chrono::steady_clock::now();
+		pMod.runParallelLocalSearch();
+		end = std::chrono::steady_clock::now();
+		stats.localSearchTime += std::chrono::duration<double>(end - start).count();
+		stats.localSearchAllocs += gNumAllocations.load() - allocs;
+	}
+	stats.cost = pMod.getCentersCost();
+	return stats;
+}
+
+// Writes a random .dat instance with numCities cities and a location every 10 cities
+static bool writeSyntheticInstance(const std::string& fileName, uint32_t numCities)
+{
+	std::ofstream stream(fileName);
+	if (!stream) {
+		return false;
+	}
+	const uint32_t numLocations = std::max(1u, numCities / 10);
+	const float side = std::sqrt(static_cast<float>(numCities));
+	std::mt19937 rng(0);
+	std::uniform_int_distribution<int> population(0, 9);
+	std::uniform_real_distribution<float> coord(0.0f, side);
+
+	stream << "nLocations = " << numLocations << ";\nnCities = " << numCities << ";\nnTypes = 5;\n";
+	stream << "p = [";
+	for (uint32_t c = 0; c < numCities; ++c) {
+		stream << ' ' << population(rng);
+	}
+	stream << " ];\nposCities = [";
+	for (uint32_t c = 0; c < numCities; ++c) {
+		stream << " [" << coord(rng) << ' ' << coord(rng) << ']';
+	}
+	stream << " ];\nposLocations = [";
+	for (uint32_t l = 0; l < numLocations; ++l) {
+		stream << " [" << coord(rng) << ' ' << coord(rng) << ']';
+	}
+	stream << " ];\nd_city = [ 1 1.5 2 2.5 3 ];\ncap = [ 100 200 300 400 500 ];\ncost = [ 10 18 25 32 38 ];\nd_center = 1.1;\n";
+	return static_cast<bool>(stream);
+}
+
+// Times the .dat parser and the binary loader on a generated instance
+static int benchmarkParser(uint32_t numCities)
+{
+	const std::string textFileName = "parse_benchmark.dat";
+	const std::string binaryFileName = "parse_benchmark.bin";
+	if (!writeSyntheticInstance(textFileName, numCities)) {
+		std::cout << "Cannot write file " << textFileName << std::endl;
+		return 1;
+	}
+
+	Model modelData;
+	auto start = std::chrono::steady_clock::now();
+	if (!modelData.readFromFile(textFileName)) {
+		std::cout << "Cannot read file " << textFileName << std::endl;
+		return 1;
+	}
+	auto end = std::chrono::steady_clock::now();
+	const double textTime = std::chrono::duration<double>(end - start).count();
+	const double textSize = static_cast<double>(std::ifstream(textFileName, std::ifstream::binary | std::ifstream::ate).tellg());
+	std::cout << numCities << " cities, .dat parsed in " << 1e3 * textTime << " ms (" << textSize / textTime / 1e6 << " MB/s)\n";
+
+	modelData.writeBinary(binaryFileName);
+	start = std::chrono::steady_clock::now();
+	Model binaryData;
+	binaryData.readFromFile(binaryFileName);
+	end = std::chrono::steady_clock::now();
+	std::cout << "binary loaded in " << 1e3 * std::chrono::duration<double>(end - start).count() << " ms\n";
+
+	std::remove(textFileName.c_str());
+	std::remove(binaryFileName.c_str());
+	return 0;
+}
+
+// Exposes the kernels of the constructive and local search phases
+class KernelModel : public GreedyModel
+{
+public:
+	using GreedyModel::GreedyModel;
+	using GreedyModel::Candidate;
+	using GreedyModel::tryAddGreedy;
+	using GreedyModel::findBestAddition;
+	using GreedyModel::findBestSwap;
+	using GreedyModel::trimLocations;
+	using GreedyModel::markAllLocationsDirty;
+};
+
+struct SuiteResult
+{
+	std::string name;
+	uint32_t cities;
+	uint32_t locations;
+	double nsPerOp;
+	uint64_t reps;
+};
+
+// Calls f until minSeconds have passed and at least minReps times, returns the mean ns per call
+template<typename F>
+static double timeCalls(F f, uint64_t& reps, double minSeconds = 0.2, uint64_t minReps = 3)
+{
+	reps = 0;
+	const auto start = std::chrono::steady_clock::now();
+	double elapsed = 0.0;
+	while (reps < minReps || elapsed < minSeconds) {
+		f();
+		++reps;
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return 1e9 * elapsed / reps;
+}
+
+// Same, with setup called before every call of f and left out of the time
+template<typename S, typename F>
+static double timeCalls(S setup, F f, uint64_t& reps, double minSeconds = 0.2, uint64_t minReps = 3)
+{
+	reps = 0;
+	double elapsed = 0.0;
+	while (reps < minReps || elapsed < minSeconds) {
+		setup();
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		++reps;
+		elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return 1e9 * elapsed / reps;
+}
+
+// Value of "key": in a line of the results, NaN if missing
+static double findNumber(const std::string& line, const std::string& key)
+{
+	const size_t pos = line.find("\"" + key + "\":");
+	if (pos == std::string::npos) {
+		return std::nan("");
+	}
+	return std::atof(line.c_str() + pos + key.size() + 3);
+}
+
+static std::string findString(const std::string& line, const std::string& key)
+{
+	const std::string prefix = "\"" + key + "\":\"";
+	const size_t pos = line.find(prefix);
+	if (pos == std::string::npos) {
+		return std::string();
+	}
+	const size_t begin = pos + prefix.size();
+	return line.substr(begin, line.find('"', begin) - begin);
+}
+
+// Times every kernel on synthetic instances of doubling size, single threaded. The
+// results are written as JSON with one result per line, and compared against a
+// previous results file if given. Starts at 1000 cities, or at maxCities if smaller.
+// Returns 2 if any result is more than 10% slower
+static int runSuite(const std::string& outputFileName, uint32_t maxCities, const std::string& baselineFileName)
+{
+	std::vector<SuiteResult> results;
+	const std::string fileName = "suite_benchmark.dat";
+	for (uint32_t numCities = std::min(1000u, maxCities); numCities <= maxCities; numCities *= 2) {
+		if (!writeSyntheticInstance(fileName, numCities)) {
+			std::cout << "Cannot write file " << fileName << std::endl;
+			return 1;
+		}
+		Model modelData;
+		if (!modelData.readFromFile(fileName)) {
+			std::cout << "Cannot read file " << fileName << std::endl;
+			return 1;
+		}
+		const uint32_t numLocations = static_cast<uint32_t>(modelData.getLocations().size());
+		const uint32_t numTypes = static_cast<uint32_t>(modelData.getCenterTypes().size());
+		auto add = [&](const std::string& name, double ns, uint64_t reps) {
+			results.push_back({ name, numCities, numLocations, ns, reps });
+			std::cout << name << "  " << numCities << " cities  " << ns / 1e3 << " us  (" << reps << " reps)" << std::endl;
+		};
+		uint64_t reps = 0;
+
+		double ns = timeCalls([&]() {
+			Model model;
+			model.readFromFile(fileName);
+		}, reps);
+		add("readFromFile", ns, reps);
+
+		ns = timeCalls([&]() {
+			ProblemInstance instance(modelData);
+		}, reps);
+		add("ProblemInstance", ns, reps);
+
+		const std::shared_ptr<const ProblemInstance> instance = std::make_shared<const ProblemInstance>(modelData);
+		KernelModel model(instance);
+		model.setNumThreads(1);
+
+		// every candidate of the empty model, per candidate
+		float sink = 0.0f;
+		ns = timeCalls([&]() {
+			for (uint32_t l = 0; l < numLocations; ++l) {
+				for (uint32_t t = 0; t < numTypes; ++t) {
+					sink += model.tryAddGreedy(l, t).fit;
+				}
+			}
+		}, reps);
+		add("tryAddGreedy", ns / (numLocations * numTypes), reps);
+
+		// with every candidate outdated, as in the first constructive step
+		ns = timeCalls([&]() {
+			model.markAllLocationsDirty();
+			sink += model.findBestAddition().fit;
+		}, reps);
+		add("findBestAddition", ns, reps);
+
+		model.setSeed(0);
+		ns = timeCalls([&]() {
+			model.purge();
+			model.GRASPConstructivePhase(0.2f);
+			model.runParallelLocalSearch();
+		}, reps);
+		add("GRASPIteration", ns, reps);
+
+		// on the solution of the last iteration
+		ns = timeCalls([&]() {
+			sink += model.findBestSwap().fit;
+		}, reps);
+		add("findBestSwap", ns, reps);
+
+		// the local search already trimmed that solution, so these start from the one of
+		// a construction every time
+		const Solution searched = model.getSolution();
+		model.purge();
+		model.GRASPConstructivePhase(0.2f);
+		const Solution constructed = model.getSolution();
+		ns = timeCalls([&]() {
+			model.setSolution(constructed);
+		}, [&]() {
+			model.trimLocations();
+		}, reps);
+		add("trimLocations", ns, reps);
+		model.setSolution(searched);
+
+		// a pass over every neighbourhood once no move improves
+		model.runNeighbourhoodDescent();
+		ns = timeCalls([&]() {
+			model.runNeighbourhoodDescent();
+		}, reps);
+		add("neighbourhoodDescent", ns, reps);
+
+		// per move, one cycle from the current solution
+		const uint64_t annealingMoves = uint64_t(1) << 18;
+		ns = timeCalls([&]() {
+			SimulatedAnnealing annealing(model);
+			annealing.setSchedule(1.0f, 0.01f, annealingMoves);
+			annealing.run(std::chrono::steady_clock::time_point::max(), 1);
+			sink += annealing.getCentersCost();
+		}, reps);
+		add("annealingMove", ns / annealingMoves, reps);
+
+		if (sink == 1.2345f) {
+			std::cout << std::endl;
+		}
+	}
+	std::remove(fileName.c_str());
+
+	std::ofstream output(outputFileName);
+	if (!output) {
+		std::cout << "Cannot write file " << outputFileName << std::endl;
+		return 1;
+	}
+	output << "{\"kernels\":\"" << getDistanceKernels().name << "\",\"threads\":1,\"results\":[\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const SuiteResult& r = results[i];
+		output << "{\"name\":\"" << r.name << "\",\"cities\":" << r.cities << ",\"locations\":" << r.locations
+			<< ",\"nsPerOp\":" << r.nsPerOp << ",\"reps\":" << r.reps << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	output << "]}\n";
+	std::cout << "Results written to " << outputFileName << std::endl;
+
+	if (baselineFileName.empty()) {
+		return 0;
+	}
+	std::ifstream baseline(baselineFileName);
+	if (!baseline) {
+		std::cout << "Cannot read file " << baselineFileName << std::endl;
+		return 1;
+	}
+	bool regression = false;
+	std::cout << "name  cities  ns/op  baseline ns/op  ratio\n";
+	std::string line;
+	while (std::getline(baseline, line)) {
+		const std::string name = findString(line, "name");
+		const double cities = findNumber(line, "cities");
+		const double baseNs = findNumber(line, "nsPerOp");
+		for (const SuiteResult& r : results) {
+			if (r.name == name && r.cities == cities) {
+				const double ratio = r.nsPerOp / baseNs;
+				const bool slower = ratio > 1.1;
+				regression = regression || slower;
+				std::cout << name << "  " << r.cities << "  " << r.nsPerOp << "  " << baseNs << "  " << ratio << (slower ? "  REGRESSION" : "") << "\n";
+			}
+		}
+	}
+	return regression ? 2 : 0;
+}
+
+static void printUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " <instance> [GRASP iterations] [max threads]\n"
+		<< "       " << program << " --parse [cities]\n"
+		<< "       " << program << " --suite <results.json> [max cities] [baseline.json]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+		printUsage(argv[0]);
+		return 0;
+	}
+	if (std::string(argv[1]) == "--parse") {
+		return benchmarkParser(argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1000000);
+	}
+	if (std::string(argv[1]) == "--suite") {
+		const uint32_t maxCities = argc > 3 ? static_cast<uint32_t>(std::atoi(argv[3])) : 8000;
+		// a suite without sizes would pass any baseline comparison
+		if (maxCities == 0) {
+			std::cout << "The max cities of --suite has to be at least 1" << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+		return runSuite(argc > 2 ? argv[2] : "benchmark_results.json", maxCities, argc > 4 ? argv[4] : "");
+	}
+	const std::string fileName = argv[1];
+	const int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+	int maxThreads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+	if (maxThreads < 1) maxThreads = 1;
+
+	Model modelData;
+	auto start = std::chrono::steady_clock::now();
+	if (!modelData.readFromFile(fileName)) {
+		std::cout << "Cannot read file " << fileName << std::endl;
+		return 1;
+	}
+	auto end = std::chrono::steady_clock::now();
+	std::cout << "Instance loaded in " << 1e3 * std::chrono::duration<double>(end - start).count() << " ms\n";
+
+	start = std::chrono::steady_clock::now();
+	const std::shared_ptr<const ProblemInstance> instance = std::make_shared<const ProblemInstance>(modelData);
+	end = std::chrono::steady_clock::now();
+	std::cout << "Instance built in " << 1e3 * std::chrono::duration<double>(end - start).count() << " ms with "
+		<< getDistanceKernels().name << " distance kernels, " << instance->getMemoryUsage() / 1024 << " KiB of tables\n";
+
+	// every model attached to the instance only allocates its own assignment
+	start = std::chrono::steady_clock::now();
+	GreedyModel pMod(instance);
+	end = std::chrono::steady_clock::now();
+	std::cout << "Model attached in " << 1e3 * std::chrono::duration<double>(end - start).count() << " ms\n";
+
+	std::cout << "Instance " << fileName << ", " << iterations << " GRASP iterations\n";
+	std::cout << "threads  constructive ms/iter  allocs/iter  local search ms/iter  allocs/iter  speedup  cost\n";
+	double baseTime = 0.0;
+	for (int threads = 1; threads <= maxThreads; ++threads) {
+		pMod.setNumThreads(threads);
+		const IterationStats stats = runGRASP(pMod, iterations);
+		const double time = stats.constructiveTime + stats.localSearchTime;
+		if (threads == 1) {
+			baseTime = time;
+		}
+		std::cout << threads << "  "
+			<< 1e3 * stats.constructiveTime / iterations << "  " << stats.constructiveAllocs / iterations << "  "
+			<< 1e3 * stats.localSearchTime / iterations << "  " << stats.localSearchAllocs / iterations << "  "
+			<< baseTime / time << "  " << stats.cost << std::endl;
+	}
+
+	// full feasibility check of the last solution
+	const int checks = 1000;
+	bool feasible = false;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < checks; ++i) {
+		feasible = pMod.isSolution();
+	}
+	end = std::chrono::steady_clock::now();
+	std::cout << "isSolution " << (feasible ? "true" : "false") << " in "
+		<< 1e6 * std::chrono::duration<double>(end - start).count() / checks << " us\n";
+
+	// independent starts on one replica per thread
+	std::cout << "replicas  starts/s  speedup  cost\n";
+	double baseRate = 0.0;
+	for (int replicas = 1; replicas <= maxThreads; ++replicas) {
+		MultiStartGRASP grasp(pMod, replicas);
+		start = std::chrono::steady_clock::now();
+		grasp.run(0.2f, std::numeric_limits<double>::infinity(), iterations, 0);
+		end = std::chrono::steady_clock::now();
+		const double rate = grasp.getIterations() / std::chrono::duration<double>(end - start).count();
+		if (replicas == 1) {
+			baseRate = rate;
+		}
+		std::cout << replicas << "  " << rate << "  " << rate / baseRate << "  " << grasp.getBestCost() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,383 @@
+#include "Model.h"
+#include "SpatialGrid.h"
+#include "ParallelReduce.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Generates instances like dataScript/dataScript.py, with the same guarantees: no two
+// locations closer than d_center, and a center of the biggest type at every location
+// can serve every city as primary and as secondary without exceeding its capacity.
+// The output only depends on the parameters and the seed, not on the threads
+
+typedef struct GeneratorOptions
+{
+	uint32_t numCities = 110;
+	uint32_t numLocations = 0;
+	uint32_t numTypes = 7;
+	uint32_t seed = 0;
+	int numThreads = 0;
+	float minDistBetweenCenters = 1.1f;
+
+	// the side of the square is sqrt(numLocations * areaPerLocation), 30x30 for 60
+	// locations as in the script
+	float areaPerLocation = 15.0f;
+
+	std::string fileName = "instance.dat";
+
+} GeneratorOptions;
+
+// SplitMix64, seeding it is free unlike mt19937, which matters with one stream per city
+typedef struct RandomStream
+{
+	typedef uint64_t result_type;
+
+	uint64_t state;
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<uint64_t>::max(); }
+
+	result_type operator()()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+} RandomStream;
+
+// Independent stream of random numbers for each (seed, stream, index)
+static RandomStream makeRng(uint32_t seed, uint32_t stream, uint32_t index)
+{
+	RandomStream rng = { (static_cast<uint64_t>(seed) << 32) | stream };
+	rng.state = rng() ^ index;
+	rng();
+	return rng;
+}
+
+// Square cells of a grid over [0, side)^2, colored so that cells with the same color
+// are at least numColors - 1 cells apart in both directions
+typedef struct CellGrid
+{
+	uint32_t numCells;
+	float cellSize;
+
+	CellGrid(float side, float minCellSize) :
+		numCells(std::max(1u, static_cast<uint32_t>(side / minCellSize))),
+		cellSize(side / std::max(1u, static_cast<uint32_t>(side / minCellSize)))
+	{
+	}
+
+	uint32_t cellOf(const vec& p) const
+	{
+		const uint32_t x = std::min(numCells - 1, static_cast<uint32_t>(std::max(0.0f, p.x / cellSize)));
+		const uint32_t y = std::min(numCells - 1, static_cast<uint32_t>(std::max(0.0f, p.y / cellSize)));
+		return y * numCells + x;
+	}
+
+	// Cells of color (cx, cy) are the ones with x % numColors == cx and y % numColors == cy
+	std::vector<uint32_t> cellsOfColor(uint32_t numColors, uint32_t cx, uint32_t cy) const
+	{
+		std::vector<uint32_t> cells;
+		for (uint32_t y = cy; y < numCells; y += numColors) {
+			for (uint32_t x = cx; x < numCells; x += numColors) {
+				cells.push_back(y * numCells + x);
+			}
+		}
+		return cells;
+	}
+} CellGrid;
+
+// Dart throwing in cells at least d_center wide: a point can only be too close to the
+// points of the 8 neighbouring cells, so cells two apart are filled in parallel
+static std::vector<vec> generateLocations(const GeneratorOptions& options, float side)
+{
+	const float minDist = options.minDistBetweenCenters;
+	const float squaredMinDist = squaredRadiusExclusive(minDist);
+	const CellGrid grid(side, std::max(minDist * 1.01f, std::sqrt(options.areaPerLocation)));
+	const uint32_t numCells = grid.numCells * grid.numCells;
+
+	// how many locations each cell gets
+	std::vector<uint32_t> quota(numCells, 0);
+	RandomStream rng = makeRng(options.seed, 0, 0);
+	std::uniform_int_distribution<uint32_t> randomCell(0, numCells - 1);
+	for (uint32_t l = 0; l < options.numLocations; ++l) {
+		quota[randomCell(rng)]++;
+	}
+
+	std::vector<std::vector<vec>> cellPoints(numCells);
+	auto fits = [&](const vec& p, const uint32_t cell) {
+		const int cx = static_cast<int>(cell % grid.numCells);
+		const int cy = static_cast<int>(cell / grid.numCells);
+		for (int y = std::max(0, cy - 1); y <= std::min<int>(grid.numCells - 1, cy + 1); ++y) {
+			for (int x = std::max(0, cx - 1); x <= std::min<int>(grid.numCells - 1, cx + 1); ++x) {
+				for (const vec& q : cellPoints[y * grid.numCells + x]) {
+					if (p.sqDist(q) <= squaredMinDist) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	};
+
+	std::vector<uint32_t> missing(numCells, 0);
+	for (uint32_t color = 0; color < 4; ++color) {
+		const std::vector<uint32_t> cells = grid.cellsOfColor(2, color % 2, color / 2);
+		parallelFor(static_cast<int>(cells.size()), options.numThreads, [&](const int i) {
+			const uint32_t cell = cells[i];
+			RandomStream cellRng = makeRng(options.seed, 1, cell);
+			const float x0 = (cell % grid.numCells) * grid.cellSize;
+			const float y0 = (cell / grid.numCells) * grid.cellSize;
+			std::uniform_real_distribution<float> offset(0.0f, grid.cellSize);
+			for (uint32_t k = 0; k < quota[cell]; ++k) {
+				bool placed = false;
+				for (uint32_t attempt = 0; attempt < 100 && !placed; ++attempt) {
+					const vec p = { std::min(x0 + offset(cellRng), side), std::min(y0 + offset(cellRng), side) };
+					if (grid.cellOf(p) == cell && fits(p, cell)) {
+						cellPoints[cell].push_back(p);
+						placed = true;
+					}
+				}
+				if (!placed) {
+					missing[cell]++;
+				}
+			}
+		}, 64);
+	}
+
+	// the few that did not fit in their cell go anywhere else, one by one. Empty if
+	// one of them finds no place
+	std::uniform_real_distribution<float> coord(0.0f, side);
+	for (uint32_t cell = 0; cell < numCells; ++cell) {
+		for (uint32_t k = 0; k < missing[cell]; ++k) {
+			bool placed = false;
+			for (uint32_t attempt = 0; attempt < 100000 && !placed; ++attempt) {
+				const vec p = { coord(rng), coord(rng) };
+				const uint32_t target = grid.cellOf(p);
+				if (fits(p, target)) {
+					cellPoints[target].push_back(p);
+					placed = true;
+				}
+			}
+			if (!placed) {
+				return {};
+			}
+		}
+	}
+
+	std::vector<vec> locations;
+	locations.reserve(options.numLocations);
+	for (const std::vector<vec>& points : cellPoints) {
+		locations.insert(locations.end(), points.begin(), points.end());
+	}
+	return locations;
+}
+
+// Cities are placed in reach of a random location, with a second location within
+// three times the reach for the secondary assignment
+static std::vector<City> generateCities(const GeneratorOptions& options, const std::vector<vec>& locations,
+	const SpatialGrid& locationGrid, float reach)
+{
+	std::vector<City> cities(options.numCities);
+	std::atomic<bool> failed(false);
+	parallelFor(static_cast<int>(options.numCities), options.numThreads, [&](const int c) {
+		RandomStream rng = makeRng(options.seed, 2, static_cast<uint32_t>(c));
+		std::uniform_int_distribution<uint32_t> randomLocation(0, static_cast<uint32_t>(locations.size()) - 1);
+		std::uniform_real_distribution<float> offset(-reach, reach);
+		std::uniform_int_distribution<uint32_t> population(0, 9);
+		const float squaredReach = squaredRadius(reach);
+		for (uint32_t attempt = 0; attempt < 1000; ++attempt) {
+			const vec& center = locations[randomLocation(rng)];
+			const vec p = { center.x + offset(rng), center.y + offset(rng) };
+			if (p.sqDist(center) > squaredReach) {
+				continue;
+			}
+			uint32_t inReach = 0;
+			locationGrid.forEachInRadius(p, 3 * reach, [&](const uint32_t) {
+				inReach++;
+			});
+			if (inReach >= 2) {
+				cities[c].cityPos = p;
+				cities[c].population = population(rng);
+				return;
+			}
+		}
+		failed = true;
+	}, 256);
+	if (failed) {
+		cities.clear();
+	}
+	return cities;
+}
+
+// Load of every location when each city is served by the least loaded locations in
+// reach, in tenths of population like the capacity constraint. A city only touches
+// locations within 3 * reach, so cells wider than that and 3 apart run in parallel
+static std::vector<uint64_t> witnessLoads(const GeneratorOptions& options, const std::vector<City>& cities,
+	uint32_t numLocations, const SpatialGrid& locationGrid, float reach, float side)
+{
+	const CellGrid grid(side + 2 * reach, 3 * reach * 1.01f);
+	std::vector<std::vector<uint32_t>> cellCities(grid.numCells * grid.numCells);
+	for (uint32_t c = 0; c < cities.size(); ++c) {
+		// cities can be up to reach outside the square
+		const vec shifted = { cities[c].cityPos.x + reach, cities[c].cityPos.y + reach };
+		cellCities[grid.cellOf(shifted)].push_back(c);
+	}
+
+	std::vector<uint64_t> loads(numLocations, 0);
+	for (uint32_t color = 0; color < 9; ++color) {
+		const std::vector<uint32_t> cells = grid.cellsOfColor(3, color % 3, color / 3);
+		parallelFor(static_cast<int>(cells.size()), options.numThreads, [&](const int i) {
+			for (const uint32_t c : cellCities[cells[i]]) {
+				const City& city = cities[c];
+				uint32_t primary = std::numeric_limits<uint32_t>::max();
+				locationGrid.forEachInRadius(city.cityPos, reach, [&](const uint32_t l) {
+					if (primary == std::numeric_limits<uint32_t>::max() || loads[l] < loads[primary] || (loads[l] == loads[primary] && l < primary)) {
+						primary = l;
+					}
+				});
+				loads[primary] += 10 * city.population;
+				uint32_t secondary = std::numeric_limits<uint32_t>::max();
+				locationGrid.forEachInRadius(city.cityPos, 3 * reach, [&](const uint32_t l) {
+					if (l != primary && (secondary == std::numeric_limits<uint32_t>::max() || loads[l] < loads[secondary] || (loads[l] == loads[secondary] && l < secondary))) {
+						secondary = l;
+					}
+				});
+				loads[secondary] += city.population;
+			}
+		}, 16);
+	}
+	return loads;
+}
+
+static void printUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options] [output.dat | output.bin]\n"
+		<< "  -c, --cities N      cities, 110 by default\n"
+		<< "  -l, --locations N   locations, 6/11 of the cities by default\n"
+		<< "  --types N           center types, 7 by default\n"
+		<< "  -s, --seed N        0 by default\n"
+		<< "  -t, --threads N     all the cores by default\n"
+		<< "  --d-center D        min distance between centers, 1.1 by default\n"
+		<< "  --area A            area of the square per location, 15 by default\n"
+		<< "The output is instance.dat by default, binary if its name ends with .bin" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	GeneratorOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if ((arg == "-c" || arg == "--cities") && i + 1 < argc) {
+			options.numCities = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if ((arg == "-l" || arg == "--locations") && i + 1 < argc) {
+			options.numLocations = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--types" && i + 1 < argc) {
+			options.numTypes = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+		}
+		else if ((arg == "-s" || arg == "--seed") && i + 1 < argc) {
+			options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+			options.numThreads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--d-center" && i + 1 < argc) {
+			options.minDistBetweenCenters = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "--area" && i + 1 < argc) {
+			options.areaPerLocation = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return 0;
+		}
+		// an unknown option, or one without its value, is not a file name
+		else if (arg.size() > 1 && arg[0] == '-') {
+			std::cout << "Unknown option or missing value: " << arg << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+		else {
+			options.fileName = arg;
+		}
+	}
+	if (options.numLocations == 0) {
+		// 60 locations for 110 cities in the script
+		options.numLocations = std::max(2u, static_cast<uint32_t>(options.numCities * 6ull / 11));
+	}
+	// dart throwing cannot fill more than about half of the densest packing
+	if (options.areaPerLocation < 2 * options.minDistBetweenCenters * options.minDistBetweenCenters) {
+		std::cout << "The area per location has to be at least 2 * d_center^2" << std::endl;
+		return 1;
+	}
+	if (options.numThreads <= 0) {
+		options.numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	const auto start = std::chrono::steady_clock::now();
+
+	// types as in the script, the biggest one also reaches the farthest so that it
+	// can serve every city by itself
+	RandomStream rng = makeRng(options.seed, 3, 0);
+	std::uniform_int_distribution<uint32_t> randomDist(2, 14);
+	std::uniform_int_distribution<uint32_t> randomCap(5, 19);
+	std::vector<CenterType> types(options.numTypes);
+	uint32_t biggest = 0;
+	float reach = 0.0f;
+	for (uint32_t t = 0; t < options.numTypes; ++t) {
+		types[t].serveDist = static_cast<float>(randomDist(rng));
+		types[t].maxPop = randomCap(rng);
+		reach = std::max(reach, types[t].serveDist);
+		if (types[t].maxPop > types[biggest].maxPop) {
+			biggest = t;
+		}
+	}
+	types[biggest].serveDist = reach;
+
+	const float side = std::sqrt(options.numLocations * options.areaPerLocation);
+	std::vector<vec> locations = generateLocations(options, side);
+	if (locations.size() != options.numLocations) {
+		std::cout << "Cannot place the locations, increase the area per location" << std::endl;
+		return 1;
+	}
+	const SpatialGrid locationGrid(locations, reach);
+	std::vector<City> cities = generateCities(options, locations, locationGrid, reach);
+	if (cities.size() != options.numCities) {
+		std::cout << "Cannot place the cities, increase the number of locations" << std::endl;
+		return 1;
+	}
+
+	// capacity for the most loaded location plus some slack, as the script does
+	const std::vector<uint64_t> loads = witnessLoads(options, cities, options.numLocations, locationGrid, reach, side);
+	const uint64_t maxLoad = *std::max_element(loads.begin(), loads.end());
+	const uint32_t extraCap = std::uniform_int_distribution<uint32_t>(0, 14)(rng);
+	types[biggest].maxPop = std::max<uint32_t>(types[biggest].maxPop, static_cast<uint32_t>((maxLoad + 9) / 10)) + extraCap;
+	const uint32_t costOffset = std::uniform_int_distribution<uint32_t>(0, 1)(rng);
+	for (CenterType& type : types) {
+		type.cost = static_cast<float>(type.maxPop / 2 + costOffset);
+	}
+
+	Model model;
+	model.setData(std::move(cities), std::move(locations), std::move(types), options.minDistBetweenCenters);
+	const bool binary = options.fileName.size() >= 4 && options.fileName.compare(options.fileName.size() - 4, 4, ".bin") == 0;
+	if (!(binary ? model.writeBinary(options.fileName) : model.writeText(options.fileName))) {
+		std::cout << "Cannot write file " << options.fileName << std::endl;
+		return 1;
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+	std::cout << options.numCities << " cities and " << options.numLocations << " locations written to " << options.fileName
+		<< " in " << std::chrono::duration<double>(end - start).count() << " seconds" << std::endl;
+	return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Allocator returning memory aligned to Alignment bytes, for SIMD loads
+template<typename T, size_t Alignment = 32>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		const size_t size = std::max<size_t>(1, (n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+#ifdef _WIN32
+		void* ptr = _aligned_malloc(size, Alignment);
+#else
+		void* ptr = std::aligned_alloc(Alignment, size);
+#endif
+		if (ptr == nullptr) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, size_t)
+	{
+#ifdef _WIN32
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,32 @@
+#include "Instrumentation.h"
+
+// Counts the heap allocations of the solver when the instrumentation is enabled.
+// Kept apart from Instrumentation.cpp so that a program with its own operator new,
+// like the benchmark, can leave it out and count through AMM_COUNT instead
+
+#ifdef AMM_INSTRUMENTATION
+
+#include <cstdlib>
+#include <new>
+
+void* operator new(std::size_t size)
+{
+	AMM_COUNT(Allocations, 1);
+	AMM_COUNT(AllocatedBytes, size);
+	if (void* ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Read only view of a contiguous array owned by someone else
+template<typename T>
+class ArrayView
+{
+public:
+	ArrayView() = default;
+
+	ArrayView(const T* data, size_t size) : mData(data), mSize(size) {}
+
+	ArrayView(const std::vector<T>& v) : mData(v.data()), mSize(v.size()) {}
+
+	const T& operator[](size_t i) const { return mData[i]; }
+
+	size_t size() const { return mSize; }
+
+	bool empty() const { return mSize == 0; }
+
+	const T* data() const { return mData; }
+
+	const T* begin() const { return mData; }
+
+	const T* end() const { return mData + mSize; }
+
+private:
+	const T* mData = nullptr;
+	size_t mSize = 0;
+};
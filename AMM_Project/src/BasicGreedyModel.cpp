@@ -3,30 +3,15 @@
 #include <algorithm>
 #include <map>
 
-BasicGreedyModel::BasicGreedyModel(const Model& model) : IModel(model)
+BasicGreedyModel::BasicGreedyModel(const Model& model) : BasicGreedyModel(std::make_shared<const ProblemInstance>(model))
+{
+
+}
+
+BasicGreedyModel::BasicGreedyModel(const std::shared_ptr<const ProblemInstance>& instance) : IModel(instance)
 {
 	mLocationTypeAssignment.resize(mNumLocations, NOT_ASSIGNED);
 	mCityCenterAssignment.resize(mNumCities, { NOT_ASSIGNED, NOT_ASSIGNED });
-	
-	mSortedCities.resize(mNumLocations * mNumCities);
-	uint32_t* pl = mSortedCities.data();
-	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		for (uint32_t c = 0; c < mNumCities; ++c) {
-			(*pl) = c;
-			pl += 1;
-		}
-	}
-
-	// internally sort
-	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		uint32_t* pl = mSortedCities.data() + l * mNumCities;
-		std::sort(pl, pl + mNumCities,
-			[&](const uint32_t& c1, const uint32_t& c2) -> bool {
-				
-				return mBaseModel.getCities()[c1].cityPos.sqDist(mBaseModel.getLocations()[l]) <
-					mBaseModel.getCities()[c2].cityPos.sqDist(mBaseModel.getLocations()[l]);
-			});
-	}
 }
 
 void BasicGreedyModel::runGreedy()
@@ -69,19 +54,22 @@ float BasicGreedyModel::tryAddGreedy(const uint32_t l, const uint32_t t) const
 	uint32_t num = 0;
 	uint32_t pop = 0;
 	const uint32_t maxPop = 10 * mBaseModel.getCenterTypes()[t].maxPop;
+	const uint32_t* population = mBaseModel.getCityPopulations().data();
 	const uint32_t* ptr = getCitiesSorted(l);
-	for (uint32_t ci = 0; ci < mNumCities; ++ci) {
+	const uint32_t numPrimary = getNumCitiesInRange(l, t, 0);
+	const uint32_t numSecondary = getNumCitiesInRange(l, t, 1);
+	for (uint32_t ci = 0; ci < numSecondary; ++ci) {
 		uint32_t c = *(ptr + ci);
-		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 0)) {
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && ci < numPrimary) {
 
-			uint32_t newPop = pop + 10 * mBaseModel.getCities()[c].population;
+			uint32_t newPop = pop + 10 * population[c];
 			if (newPop > maxPop) {
 				break;
 			}
 			pop = newPop;
 		}
-		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 1)) {
-			uint32_t newPop = pop + mBaseModel.getCities()[c].population;
+		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED) {
+			uint32_t newPop = pop + population[c];
 			if (newPop > maxPop) {
 				break;
 			}
@@ -92,11 +80,6 @@ float BasicGreedyModel::tryAddGreedy(const uint32_t l, const uint32_t t) const
 	return mBaseModel.getCenterTypes()[t].cost / static_cast<float>(pop) * 10.0f;
 }
 
-const uint32_t* BasicGreedyModel::getCitiesSorted(const uint32_t l) const
-{
-	return mSortedCities.data() + l * mNumCities;
-}
-
 std::pair<uint32_t, uint32_t> BasicGreedyModel::findBestAddition() const
 {
 	std::pair<uint32_t, uint32_t> res = {NOT_ASSIGNED, NOT_ASSIGNED};
@@ -121,20 +104,23 @@ void BasicGreedyModel::applyAction(const uint32_t l, const uint32_t t)
 {
 	uint32_t pop = 0;
 	const uint32_t maxPop = 10 * mBaseModel.getCenterTypes()[t].maxPop;
+	const uint32_t* population = mBaseModel.getCityPopulations().data();
 
 	const uint32_t* ptr = getCitiesSorted(l);
-	for (uint32_t ci = 0; ci < mNumCities; ++ci) {
+	const uint32_t numPrimary = getNumCitiesInRange(l, t, 0);
+	const uint32_t numSecondary = getNumCitiesInRange(l, t, 1);
+	for (uint32_t ci = 0; ci < numSecondary; ++ci) {
 		uint32_t c = *(ptr + ci);
-		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 0)) {
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && ci < numPrimary) {
 
-			uint32_t newPop = pop + 10 * mBaseModel.getCities()[c].population;
+			uint32_t newPop = pop + 10 * population[c];
 			if (newPop <= maxPop) {
 				pop = newPop;
 				mCityCenterAssignment[c].first = l;
 			}
 		}
-		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 1)) {
-			uint32_t newPop = pop + mBaseModel.getCities()[c].population;
+		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED) {
+			uint32_t newPop = pop + population[c];
 			if (newPop <= maxPop) {
 				pop = newPop;
 				mCityCenterAssignment[c].second = l;
@@ -143,7 +129,7 @@ void BasicGreedyModel::applyAction(const uint32_t l, const uint32_t t)
 		}
 	}
 
-	mLocationTypeAssignment[l] = t;
+	setLocationType(l, t);
 }
 
 
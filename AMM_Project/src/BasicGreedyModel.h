@@ -12,19 +12,15 @@ public:
 
 	BasicGreedyModel(const Model& model);
 
+	// Attaches to an instance shared with other models
+	BasicGreedyModel(const std::shared_ptr<const ProblemInstance>& instance);
+
 	void runGreedy();
 
 protected:
 
-
-	// array of num cities * num locations, 
-	std::vector<uint32_t> mSortedCities;
-
 	float tryAddGreedy(const uint32_t l, const uint32_t t) const;
 
-	const uint32_t* getCitiesSorted(const uint32_t l) const;
-
-
 	// Returns location and type
 	std::pair<uint32_t, uint32_t> findBestAddition() const;
 
@@ -0,0 +1,191 @@
+#include "BatchSolver.h"
+#include "MultiStartGRASP.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static std::string csvField(const std::string& s)
+{
+	if (s.find_first_of(",\"\r\n") == std::string::npos) {
+		return s;
+	}
+	std::string quoted = "\"";
+	for (const char c : s) {
+		quoted += c;
+		if (c == '"') {
+			quoted += '"';
+		}
+	}
+	return quoted + "\"";
+}
+
+static std::string jsonString(const std::string& s)
+{
+	std::string escaped = "\"";
+	for (const char c : s) {
+		switch (c) {
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char code[8];
+				std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+				escaped += code;
+			}
+			else {
+				escaped += c;
+			}
+		}
+	}
+	return escaped + "\"";
+}
+
+BatchSolver::BatchSolver(const BatchOptions& options, std::ostream& out) :
+	mOptions(options),
+	mOut(out)
+{
+	if (mOptions.numThreads <= 0) {
+		mOptions.numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+}
+
+bool BatchSolver::listInstances(const std::string& path, std::vector<std::string>& instances)
+{
+	instances.clear();
+	std::error_code error;
+	if (fs::is_directory(path, error)) {
+		fs::directory_iterator entries(path, error);
+		if (error) {
+			return false;
+		}
+		for (const fs::directory_entry& entry : entries) {
+			const std::string extension = entry.path().extension().string();
+			if (entry.is_regular_file(error) && (extension == ".dat" || extension == ".bin")) {
+				instances.push_back(entry.path().string());
+			}
+		}
+		// directory order is unspecified
+		std::sort(instances.begin(), instances.end());
+		return true;
+	}
+
+	std::ifstream manifest(path);
+	if (!manifest) {
+		return false;
+	}
+	const fs::path base = fs::path(path).parent_path();
+	std::string line;
+	while (std::getline(manifest, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		const fs::path file(line);
+		instances.push_back(file.is_absolute() ? file.string() : (base / file).string());
+	}
+	return true;
+}
+
+void BatchSolver::run(const std::vector<std::string>& instances)
+{
+	if (!mOptions.json) {
+		mOut << "instance,loaded,cost,feasible,seconds,iterations" << std::endl;
+	}
+
+	// biggest first, the file size is a cheap estimate of the work
+	std::vector<std::pair<uint64_t, std::string>> bySize;
+	for (const std::string& instance : instances) {
+		std::error_code error;
+		const uint64_t size = fs::file_size(instance, error);
+		bySize.push_back({ error ? 0 : size, instance });
+	}
+	std::stable_sort(bySize.begin(), bySize.end(), [](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b) {
+		return a.first > b.first;
+	});
+
+	// large instances one at a time, with one replica per thread
+	size_t i = 0;
+	for (; i < bySize.size() && bySize[i].first >= mOptions.largeInstanceBytes; ++i) {
+		write(solve(bySize[i].second, mOptions.numThreads));
+	}
+
+	WorkStealingPool pool(mOptions.numThreads);
+	for (; i < bySize.size(); ++i) {
+		const std::string instance = bySize[i].second;
+		pool.submit([this, instance]() {
+			write(solve(instance, 1));
+		});
+	}
+	pool.wait();
+}
+
+BatchResult BatchSolver::solve(const std::string& instance, int numReplicas) const
+{
+	BatchResult result;
+	result.instance = instance;
+	const auto start = std::chrono::steady_clock::now();
+
+	SolverLimits limits;
+	limits.deadline = deadlineAfter(start, mOptions.secondsPerInstance);
+	limits.maxIterations = mOptions.maxIterations;
+	limits.targetCost = mOptions.targetCost;
+
+	Model modelData;
+	result.loaded = modelData.readFromFile(instance);
+	if (result.loaded) {
+		GreedyModel model(std::make_shared<const ProblemInstance>(modelData));
+		MultiStartGRASP grasp(model, numReplicas);
+		grasp.setReactiveAlphas(mOptions.reactiveAlphas, mOptions.alphaWeights);
+		grasp.setPathRelinking(mOptions.eliteSize, 4);
+		grasp.run(mOptions.alpha, limits, mOptions.seed);
+		result.feasible = grasp.getBest() != nullptr;
+		result.cost = grasp.getBestCost();
+		result.iterations = grasp.getIterations();
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+void BatchSolver::write(const BatchResult& result)
+{
+	std::ostringstream line;
+	if (mOptions.json) {
+		line << "{\"instance\":" << jsonString(result.instance)
+			<< ",\"loaded\":" << (result.loaded ? "true" : "false")
+			<< ",\"cost\":";
+		// JSON has no infinity
+		if (result.feasible) {
+			line << result.cost;
+		}
+		else {
+			line << "null";
+		}
+		line << ",\"feasible\":" << (result.feasible ? "true" : "false")
+			<< ",\"seconds\":" << result.seconds
+			<< ",\"iterations\":" << result.iterations << "}";
+	}
+	else {
+		line << csvField(result.instance) << "," << (result.loaded ? 1 : 0) << ",";
+		if (result.feasible) {
+			line << result.cost;
+		}
+		line << "," << (result.feasible ? 1 : 0) << "," << result.seconds << "," << result.iterations;
+	}
+
+	std::lock_guard<std::mutex> lock(mOutMutex);
+	mOut << line.str() << std::endl;
+}
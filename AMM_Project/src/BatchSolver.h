@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+typedef struct BatchOptions
+{
+	// 0 for all the hardware threads
+	int numThreads = 0;
+
+	// limits of each instance, from the moment it starts loading
+	double secondsPerInstance = 60.0;
+	uint64_t maxIterations = 0;
+	float targetCost = -std::numeric_limits<float>::infinity();
+
+	uint32_t seed = 0;
+	float alpha = 0.2f;
+
+	// alphas of reactive GRASP and their initial probabilities, uniform if empty.
+	// Without alphas every start uses alpha
+	std::vector<float> reactiveAlphas;
+	std::vector<float> alphaWeights;
+
+	// elite pool size for path relinking, 0 keeps every start independent
+	size_t eliteSize = 0;
+
+	// JSON lines instead of CSV
+	bool json = false;
+
+	// instance files of at least this size run one at a time on all the threads,
+	// smaller ones run one per thread
+	uint64_t largeInstanceBytes = uint64_t(1) << 20;
+
+} BatchOptions;
+
+typedef struct BatchResult
+{
+	std::string instance;
+	bool loaded = false;
+	bool feasible = false;
+	float cost = std::numeric_limits<float>::infinity();
+	double seconds = 0.0;
+	uint64_t iterations = 0;
+
+} BatchResult;
+
+// Solves many instances with the multi-start GRASP and writes one line per instance
+// as soon as it finishes, so the lines are in completion order
+class BatchSolver
+{
+public:
+
+	BatchSolver(const BatchOptions& options, std::ostream& out);
+
+	// The .dat and .bin files of a directory, or the files listed one per line in a
+	// manifest, relative to it. Empty lines and lines starting with # are skipped.
+	// False if path is neither a readable directory nor a readable file
+	static bool listInstances(const std::string& path, std::vector<std::string>& instances);
+
+	// Writes the CSV header when needed, then the results
+	void run(const std::vector<std::string>& instances);
+
+private:
+
+	BatchOptions mOptions;
+	std::ostream& mOut;
+	std::mutex mOutMutex;
+
+	BatchResult solve(const std::string& instance, int numReplicas) const;
+
+	void write(const BatchResult& result);
+};
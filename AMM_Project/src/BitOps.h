@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit, mask != 0
+inline uint32_t lowestBit(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<unsigned long>(mask))) {
+		return index;
+	}
+	_BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+	return index + 32;
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+}
+
+// Calls f(i) for every set bit i of the numWords words of bits
+template<typename F>
+void forEachSetBit(const uint64_t* bits, const uint32_t numWords, F f)
+{
+	for (uint32_t w = 0; w < numWords; ++w) {
+		uint64_t word = bits[w];
+		while (word != 0) {
+			f(w * 64 + lowestBit(word));
+			word &= word - 1;
+		}
+	}
+}
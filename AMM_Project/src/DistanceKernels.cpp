@@ -0,0 +1,247 @@
+#include "DistanceKernels.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AMM_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC accepts any intrinsic without enabling the instruction set for the whole file
+#define AMM_TARGET_AVX2
+#else
+#define AMM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(AMM_X86) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define AMM_SSE2 1
+#endif
+
+float squaredRadius(float radius)
+{
+	if (!(radius >= 0.0f)) {
+		return -1.0f;
+	}
+	if (std::isinf(radius)) {
+		return radius;
+	}
+	float r2 = radius * radius;
+	while (std::sqrt(r2) > radius) {
+		r2 = std::nextafter(r2, 0.0f);
+	}
+	while (std::sqrt(std::nextafter(r2, std::numeric_limits<float>::infinity())) <= radius) {
+		r2 = std::nextafter(r2, std::numeric_limits<float>::infinity());
+	}
+	return r2;
+}
+
+float squaredRadiusExclusive(float radius)
+{
+	if (!(radius > 0.0f)) {
+		return -1.0f;
+	}
+	if (std::isinf(radius)) {
+		return std::numeric_limits<float>::max();
+	}
+	float r2 = radius * radius;
+	while (r2 > 0.0f && std::sqrt(r2) >= radius) {
+		r2 = std::nextafter(r2, 0.0f);
+	}
+	while (std::sqrt(std::nextafter(r2, std::numeric_limits<float>::infinity())) < radius) {
+		r2 = std::nextafter(r2, std::numeric_limits<float>::infinity());
+	}
+	return r2;
+}
+
+namespace
+{
+	inline float squaredDistance(const float x, const float y, const float px, const float py)
+	{
+		const float dx = x - px;
+		const float dy = y - py;
+		return dx * dx + dy * dy;
+	}
+
+	void squaredDistancesScalar(const float* xs, const float* ys, size_t n, float px, float py, float* out)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			out[i] = squaredDistance(xs[i], ys[i], px, py);
+		}
+	}
+
+	void squaredDistancesIndexedScalar(const float* xs, const float* ys, const uint32_t* idx, size_t n, float px, float py, float* out)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			out[i] = squaredDistance(xs[idx[i]], ys[idx[i]], px, py);
+		}
+	}
+
+	uint64_t maskWithinScalar(const float* xs, const float* ys, size_t n, float px, float py, float r2)
+	{
+		uint64_t mask = 0;
+		for (size_t i = 0; i < n; ++i) {
+			if (squaredDistance(xs[i], ys[i], px, py) <= r2) {
+				mask |= uint64_t(1) << i;
+			}
+		}
+		return mask;
+	}
+
+#ifdef AMM_SSE2
+	inline __m128 squaredDistance4(const __m128 x, const __m128 y, const __m128 px, const __m128 py)
+	{
+		const __m128 dx = _mm_sub_ps(x, px);
+		const __m128 dy = _mm_sub_ps(y, py);
+		return _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+	}
+
+	void squaredDistancesSSE2(const float* xs, const float* ys, size_t n, float px, float py, float* out)
+	{
+		const __m128 vpx = _mm_set1_ps(px);
+		const __m128 vpy = _mm_set1_ps(py);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm_storeu_ps(out + i, squaredDistance4(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i), vpx, vpy));
+		}
+		squaredDistancesScalar(xs + i, ys + i, n - i, px, py, out + i);
+	}
+
+	void squaredDistancesIndexedSSE2(const float* xs, const float* ys, const uint32_t* idx, size_t n, float px, float py, float* out)
+	{
+		const __m128 vpx = _mm_set1_ps(px);
+		const __m128 vpy = _mm_set1_ps(py);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m128 x = _mm_setr_ps(xs[idx[i]], xs[idx[i + 1]], xs[idx[i + 2]], xs[idx[i + 3]]);
+			const __m128 y = _mm_setr_ps(ys[idx[i]], ys[idx[i + 1]], ys[idx[i + 2]], ys[idx[i + 3]]);
+			_mm_storeu_ps(out + i, squaredDistance4(x, y, vpx, vpy));
+		}
+		squaredDistancesIndexedScalar(xs, ys, idx + i, n - i, px, py, out + i);
+	}
+
+	uint64_t maskWithinSSE2(const float* xs, const float* ys, size_t n, float px, float py, float r2)
+	{
+		const __m128 vpx = _mm_set1_ps(px);
+		const __m128 vpy = _mm_set1_ps(py);
+		const __m128 vr2 = _mm_set1_ps(r2);
+		uint64_t mask = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m128 d2 = squaredDistance4(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i), vpx, vpy);
+			mask |= static_cast<uint64_t>(_mm_movemask_ps(_mm_cmple_ps(d2, vr2))) << i;
+		}
+		if (i < n) {
+			mask |= maskWithinScalar(xs + i, ys + i, n - i, px, py, r2) << i;
+		}
+		return mask;
+	}
+
+	AMM_TARGET_AVX2 inline __m256 squaredDistance8(const __m256 x, const __m256 y, const __m256 px, const __m256 py)
+	{
+		const __m256 dx = _mm256_sub_ps(x, px);
+		const __m256 dy = _mm256_sub_ps(y, py);
+		return _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+	}
+
+	AMM_TARGET_AVX2 void squaredDistancesAVX2(const float* xs, const float* ys, size_t n, float px, float py, float* out)
+	{
+		const __m256 vpx = _mm256_set1_ps(px);
+		const __m256 vpy = _mm256_set1_ps(py);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			_mm256_storeu_ps(out + i, squaredDistance8(_mm256_loadu_ps(xs + i), _mm256_loadu_ps(ys + i), vpx, vpy));
+		}
+		squaredDistancesScalar(xs + i, ys + i, n - i, px, py, out + i);
+	}
+
+	AMM_TARGET_AVX2 void squaredDistancesIndexedAVX2(const float* xs, const float* ys, const uint32_t* idx, size_t n, float px, float py, float* out)
+	{
+		const __m256 vpx = _mm256_set1_ps(px);
+		const __m256 vpy = _mm256_set1_ps(py);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256i vidx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + i));
+			const __m256 x = _mm256_i32gather_ps(xs, vidx, 4);
+			const __m256 y = _mm256_i32gather_ps(ys, vidx, 4);
+			_mm256_storeu_ps(out + i, squaredDistance8(x, y, vpx, vpy));
+		}
+		squaredDistancesIndexedScalar(xs, ys, idx + i, n - i, px, py, out + i);
+	}
+
+	AMM_TARGET_AVX2 uint64_t maskWithinAVX2(const float* xs, const float* ys, size_t n, float px, float py, float r2)
+	{
+		const __m256 vpx = _mm256_set1_ps(px);
+		const __m256 vpy = _mm256_set1_ps(py);
+		const __m256 vr2 = _mm256_set1_ps(r2);
+		uint64_t mask = 0;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 d2 = squaredDistance8(_mm256_loadu_ps(xs + i), _mm256_loadu_ps(ys + i), vpx, vpy);
+			mask |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_cmp_ps(d2, vr2, _CMP_LE_OQ))) << i;
+		}
+		if (i < n) {
+			mask |= maskWithinScalar(xs + i, ys + i, n - i, px, py, r2) << i;
+		}
+		return mask;
+	}
+
+	bool cpuSupportsAVX2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		// the OS has to save the AVX registers too
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	const DistanceKernels SCALAR_KERNELS = { "scalar", squaredDistancesScalar, squaredDistancesIndexedScalar, maskWithinScalar };
+#ifdef AMM_SSE2
+	const DistanceKernels SSE2_KERNELS = { "SSE2", squaredDistancesSSE2, squaredDistancesIndexedSSE2, maskWithinSSE2 };
+	const DistanceKernels AVX2_KERNELS = { "AVX2", squaredDistancesAVX2, squaredDistancesIndexedAVX2, maskWithinAVX2 };
+#endif
+}
+
+const DistanceKernels* getDistanceKernels(SimdLevel level)
+{
+	switch (level) {
+	case SimdLevel::Scalar:
+		return &SCALAR_KERNELS;
+#ifdef AMM_SSE2
+	case SimdLevel::SSE2:
+		return &SSE2_KERNELS;
+	case SimdLevel::AVX2:
+		return cpuSupportsAVX2() ? &AVX2_KERNELS : nullptr;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+const DistanceKernels& getDistanceKernels()
+{
+	static const DistanceKernels* kernels = []() {
+		for (SimdLevel level : { SimdLevel::AVX2, SimdLevel::SSE2 }) {
+			if (const DistanceKernels* k = getDistanceKernels(level)) {
+				return k;
+			}
+		}
+		return &SCALAR_KERNELS;
+	}();
+	return *kernels;
+}
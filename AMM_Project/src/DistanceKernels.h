@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "AlignedAllocator.h"
+
+// Coordinates of a set of points in separate arrays
+typedef struct PointsSoA
+{
+	AlignedVector<float> x;
+	AlignedVector<float> y;
+} PointsSoA;
+
+// Largest squared distance d2 with sqrt(d2) <= radius, comparing squared distances
+// against it gives exactly the same result as comparing the distances against radius
+float squaredRadius(float radius);
+
+// Largest squared distance d2 with sqrt(d2) < radius
+float squaredRadiusExclusive(float radius);
+
+// Batch squared distance kernels over points in SoA layout, computed as
+// dx * dx + dy * dy like vec2::sqDist so that all of them agree bit by bit
+typedef struct DistanceKernels
+{
+	const char* name;
+
+	// out[i] = squared distance from (px, py) to (xs[i], ys[i]) for i < n
+	void (*squaredDistances)(const float* xs, const float* ys, size_t n, float px, float py, float* out);
+
+	// out[i] = squared distance from (px, py) to (xs[idx[i]], ys[idx[i]]) for i < n
+	void (*squaredDistancesIndexed)(const float* xs, const float* ys, const uint32_t* idx, size_t n, float px, float py, float* out);
+
+	// Bit i is set if the squared distance from (px, py) to point i is <= r2, n <= 64
+	uint64_t (*maskWithin)(const float* xs, const float* ys, size_t n, float px, float py, float r2);
+
+} DistanceKernels;
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// The kernels of the best level supported by the CPU, chosen on first use
+const DistanceKernels& getDistanceKernels();
+
+// Kernels of the given level, nullptr if the CPU or the build does not support it
+const DistanceKernels* getDistanceKernels(SimdLevel level);
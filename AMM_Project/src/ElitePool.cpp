@@ -0,0 +1,59 @@
+#include "ElitePool.h"
+
+#include <algorithm>
+#include <limits>
+
+ElitePool::ElitePool(size_t capacity, uint32_t minDistance) : mCapacity(capacity), mMinDistance(minDistance)
+{
+	mMembers.reserve(capacity);
+}
+
+bool ElitePool::offer(const Solution& solution)
+{
+	if (mCapacity == 0) {
+		return false;
+	}
+
+	bool best = true;
+	bool worseMember = false;
+	uint32_t minDistance = std::numeric_limits<uint32_t>::max();
+	// the most similar of the members worse than solution, the worst one on ties
+	size_t replaced = mMembers.size();
+	uint32_t replacedDistance = std::numeric_limits<uint32_t>::max();
+	for (size_t i = 0; i < mMembers.size(); ++i) {
+		const Solution& member = mMembers[i];
+		const uint32_t d = distance(solution, member);
+		minDistance = std::min(minDistance, d);
+		if (member.cost <= solution.cost) {
+			best = false;
+			continue;
+		}
+		worseMember = true;
+		if (d < replacedDistance || (d == replacedDistance && member.cost > mMembers[replaced].cost)) {
+			replaced = i;
+			replacedDistance = d;
+		}
+	}
+
+	if (!best && (minDistance < mMinDistance || (mMembers.size() == mCapacity && !worseMember))) {
+		return false;
+	}
+	// a better solution too close to a member takes its place, so that the pool
+	// never holds two similar ones
+	if (mMembers.size() < mCapacity && minDistance >= mMinDistance) {
+		mMembers.push_back(solution);
+	}
+	else {
+		mMembers[replaced] = solution;
+	}
+	return true;
+}
+
+uint32_t ElitePool::distance(const Solution& a, const Solution& b)
+{
+	uint32_t d = 0;
+	for (size_t l = 0; l < a.locationTypes.size(); ++l) {
+		d += a.locationTypes[l] != b.locationTypes[l] ? 1 : 0;
+	}
+	return d;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Solution.h"
+
+// The best feasible solutions found, kept apart from each other so that path
+// relinking has different center sets to walk between. Two solutions differ by
+// the number of locations whose type differs. Not thread safe
+class ElitePool
+{
+public:
+
+	ElitePool(size_t capacity, uint32_t minDistance);
+
+	// Keeps solution if it is better than every member, or if it differs by at least
+	// the min distance from every member and the pool has room or a worse member.
+	// When full it replaces the most similar of the worse members
+	bool offer(const Solution& solution);
+
+	size_t size() const { return mMembers.size(); }
+	size_t capacity() const { return mCapacity; }
+
+	const Solution& operator[](size_t i) const { return mMembers[i]; }
+
+	void clear() { mMembers.clear(); }
+
+	// Locations whose type differs
+	static uint32_t distance(const Solution& a, const Solution& b);
+
+private:
+
+	size_t mCapacity;
+	uint32_t mMinDistance;
+	std::vector<Solution> mMembers;
+};
@@ -1,4 +1,7 @@
 #include "GreedyModel.h"
+#include "ParallelReduce.h"
+#include "Instrumentation.h"
+#include "MaxFlow.h"
 
 #include <algorithm>
 #include <map>
@@ -6,30 +9,44 @@
 #include <omp.h>
 
 const double EulerConstant = std::exp(1.0);
-GreedyModel::GreedyModel(const Model& model) : IModel(model)
+
+// intermediate solutions of a path relinking are the steps but the last one
+const size_t PATH_RELINKING_STEPS = 8;
+
+// moves of a chain of repairAssignment, and centers each search may try
+const uint32_t MAX_CHAIN_DEPTH = 3;
+const uint32_t CHAIN_BUDGET = 20000;
+
+// Total order used by the parallel argmax, ties go to the lowest index
+static bool isBetterCandidate(const float fit1, const uint32_t i1, const float fit2, const uint32_t i2)
+{
+	return fit1 > fit2 || (fit1 == fit2 && i1 < i2);
+}
+
+GreedyModel::GreedyModel(const Model& model) : GreedyModel(std::make_shared<const ProblemInstance>(model))
+{
+
+}
+
+GreedyModel::GreedyModel(const std::shared_ptr<const ProblemInstance>& instance) : IModel(instance)
 {
+	mNumThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
 	mLocationTypeAssignment.resize(mNumLocations, NOT_ASSIGNED);
 	mCityCenterAssignment.resize(mNumCities, { NOT_ASSIGNED, NOT_ASSIGNED });
 	
-	mSortedCities.resize(mNumLocations * mNumCities);
-	uint32_t* pl = mSortedCities.data();
-	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		for (uint32_t c = 0; c < mNumCities; ++c) {
-			(*pl) = c;
-			pl += 1;
-		}
-	}
+	mCenterServing.resize(mNumLocations, 0.0f);
+	mCenterExpLoad.resize(mNumLocations, 0.0);
 
-	// internally sort
-	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		uint32_t* pl = mSortedCities.data() + l * mNumCities;
-		std::sort(pl, pl + mNumCities,
-			[&](const uint32_t& c1, const uint32_t& c2) -> bool {
-				
-				return mBaseModel.getCities()[c1].cityPos.sqDist(mBaseModel.getLocations()[l]) <
-					mBaseModel.getCities()[c2].cityPos.sqDist(mBaseModel.getLocations()[l]);
-			});
+	mCandidates.resize(mNumLocations * mNumTypes);
+	for (uint32_t i = 0; i < mCandidates.size(); ++i) {
+		mCandidates[i].fit = -std::numeric_limits<float>::infinity();
+		mCandidates[i].loc = i / mNumTypes;
+		mCandidates[i].type = i % mNumTypes;
+		mCandidates[i].cutoff = 0;
 	}
+	mLocationIsDirty.resize(mNumLocations, 0);
+	mDirtyLocations.reserve(mNumLocations);
 }
 
 void GreedyModel::runGreedy()
@@ -46,13 +63,9 @@ void GreedyModel::runGreedy()
 
 	float actual = numToAssign();
 
-	const int processor_count = std::thread::hardware_concurrency();
-	int perThread = static_cast<int>((std::ceil(static_cast<float>(mNumLocations) / processor_count)));
-	if (perThread < 1) perThread = 1;
-	std::vector<Candidate> bestCandidates(processor_count);
-
-	while (!isSolutionFast()) {
-		Candidate bestAction = findBestAddition(bestCandidates, perThread, processor_count);
+	markAllLocationsDirty();
+	while (!isSolutionFast() && std::chrono::steady_clock::now() < mDeadline) {
+		Candidate bestAction = findBestAddition();
 		if (bestAction.fit==-std::numeric_limits<float>::infinity()) break;
 		applyAction(bestAction);
 		float n = numToAssign();
@@ -64,147 +77,242 @@ void GreedyModel::runGreedy()
 	trimLocations();
 }
 
-GreedyModel::Candidate GreedyModel::tryAddGreedy(const uint32_t l, const uint32_t t, std::vector<char>& assignments) const
+GreedyModel::Candidate GreedyModel::tryAddGreedy(const uint32_t l, const uint32_t t) const
 {
+	Candidate bestCandidate;
+	bestCandidate.type = t;
+	bestCandidate.loc = l;
+	bestCandidate.cutoff = 0;
+	AMM_COUNT(TryAddGreedy, 1);
 	if (mLocationTypeAssignment[l] != NOT_ASSIGNED || locationIsBlocked(l)) {
-		Candidate infeasible;
-		infeasible.fit = -std::numeric_limits<float>::infinity();
-		return infeasible;
+		AMM_COUNT(CandidatesBlocked, 1);
+		bestCandidate.fit = -std::numeric_limits<float>::infinity();
+		return bestCandidate;
 	}
-	std::fill(assignments.begin(), assignments.end(), 0);
-	uint32_t num = 0;
+	AMM_COUNT(CandidatesEvaluated, 1);
 	uint32_t pop = 0;
 	const uint32_t maxPop = 10 * mBaseModel.getCenterTypes()[t].maxPop;
+	const uint32_t* population = mBaseModel.getCityPopulations().data();
 	const uint32_t* ptr = getCitiesSorted(l);
+	const uint32_t numPrimary = getNumCitiesInRange(l, t, 0);
+	const uint32_t numSecondary = getNumCitiesInRange(l, t, 1);
 
-	Candidate bestCandidate;
 	uint32_t ci = 0;
-	for (ci = 0; ci < mNumCities; ++ci) {
+	for (ci = 0; ci < numSecondary; ++ci) {
 		uint32_t c = *(ptr + ci);
-		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 0)) {
-			uint32_t newPop = pop + 10 * mBaseModel.getCities()[c].population;
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && ci < numPrimary) {
+			uint32_t newPop = pop + 10 * population[c];
 			if (newPop > maxPop) {
 				break;
 			}
-			assignments[ci]=1;
 			pop = newPop;
 		}
-		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 1)) {
-			uint32_t newPop = pop + mBaseModel.getCities()[c].population;
+		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED) {
+			uint32_t newPop = pop + population[c];
 			if (newPop > maxPop) {
 				break;
 			}
-			assignments[ci]=2;
 			pop = newPop;
 		}
-		else {
-			assignments[ci]=0;
-		}
 	}
-	if (ci < mNumCities - 1) assignments[ci + 1] = 3;
 	int freeCities = 0;
-	for (int it = ci; it < mNumCities; ++it) {
+	for (uint32_t it = ci; it < numSecondary; ++it) {
 		uint32_t c = *(ptr + it);
-		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 0)) freeCities += 2;
-		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED && isCityLocationTypeCompatible(c, l, t, 1)) freeCities += 1;
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && it < numPrimary) freeCities += 2;
+		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED) freeCities += 1;
 	}
 	bestCandidate.fit = (static_cast<float>(pop) * 0.1f / mBaseModel.getCenterTypes()[t].cost) - freeCities/5;
-	bestCandidate.assigns = std::vector<char> (assignments);
-	bestCandidate.type = t;
-	bestCandidate.loc = l;
+	bestCandidate.cutoff = ci;
 
 	return bestCandidate;
 }
-const uint32_t* GreedyModel::getCitiesSorted(const uint32_t l) const
+
+void GreedyModel::setIncrementalEvaluation(bool enabled)
+{
+	mIncrementalEvaluation = enabled;
+}
+
+void GreedyModel::setNumThreads(int numThreads)
+{
+	mNumThreads = std::max(1, numThreads);
+}
+
+void GreedyModel::setSeed(uint32_t seed)
+{
+	mRng.seed(seed);
+}
+
+void GreedyModel::setLocalSearchLimits(uint32_t maxSwaps, uint32_t maxNonImproving)
+{
+	mMaxSwaps = maxSwaps;
+	mMaxNonImproving = maxNonImproving;
+}
+
+void GreedyModel::setDescentLimit(uint32_t maxMoves)
 {
-	return mSortedCities.data() + l * mNumCities;
+	mMaxMoves = maxMoves;
 }
 
-GreedyModel::Candidate GreedyModel::findBestAddition(std::vector<Candidate> &bestCandidates, uint32_t perThread, int processor_count) const
+void GreedyModel::setDeadline(std::chrono::steady_clock::time_point deadline)
 {
-    #pragma omp parallel num_threads(processor_count)
-    {
-        const int c = omp_get_thread_num(); 
-        Candidate bestCandidate;
-        bestCandidate.fit= -std::numeric_limits<float>::infinity();
-		std::vector<char> assignments(mNumCities);
-        for (uint32_t l = c*perThread ; l < (c+1)*perThread && l < mNumLocations; ++l) {
-            for (uint32_t t = 0; t < mNumTypes; ++t) {
-                Candidate currentCandidate = tryAddGreedy(l, t, assignments);
-                if (currentCandidate.fit>bestCandidate.fit) {
-                    bestCandidate=currentCandidate;
-                }
-            }
-        }
-		bestCandidates[omp_get_thread_num()] = bestCandidate;
-    }
+	mDeadline = deadline;
+}
 
-	float bestFit = -std::numeric_limits<float>::infinity();
-	int bestPos = 0;
-	for (int i = 0; i < processor_count; ++i) {
-		if (bestCandidates[i].fit > bestFit) {
-			bestFit = bestCandidates[i].fit;
-			bestPos = i;
+void GreedyModel::markLocationDirty(const uint32_t l)
+{
+	if (!mLocationIsDirty[l]) {
+		mLocationIsDirty[l] = 1;
+		mDirtyLocations.push_back(l);
+	}
+}
+
+void GreedyModel::markAllLocationsDirty()
+{
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		markLocationDirty(l);
+	}
+}
+
+void GreedyModel::refreshCandidates()
+{
+	if (!mIncrementalEvaluation) {
+		markAllLocationsDirty();
+	}
+
+	parallelFor(static_cast<int>(mDirtyLocations.size()), mNumThreads, [&](const int i) {
+		const uint32_t l = mDirtyLocations[i];
+		for (uint32_t t = 0; t < mNumTypes; ++t) {
+			mCandidates[l * mNumTypes + t] = tryAddGreedy(l, t);
 		}
+	});
+
+	for (const uint32_t l : mDirtyLocations) {
+		mLocationIsDirty[l] = 0;
 	}
-    return std::move(bestCandidates[bestPos]);
+	mDirtyLocations.clear();
+}
+
+GreedyModel::Candidate GreedyModel::findBestAddition()
+{
+	refreshCandidates();
+
+	// first candidate with the best fit, in (location, type) order
+	auto keepBest = [&](uint32_t& best, const uint32_t i) {
+		if (isBetterCandidate(mCandidates[i].fit, i, mCandidates[best].fit, best)) {
+			best = i;
+		}
+	};
+	// only the available locations can have a feasible candidate
+	const uint32_t bestPos = parallelReduce(static_cast<int>(mAvailableLocations.size() * mNumTypes), mNumThreads, uint32_t(0),
+		[&](const int i, uint32_t& best) { keepBest(best, availableCandidate(i)); },
+		[&](uint32_t& best, const uint32_t other) { keepBest(best, other); },
+		4096);
+	return mCandidates[bestPos];
 }
 
 
 void GreedyModel::applyAction(const Candidate& bestActions)
 {
+	// The new center and the locations it blocks are no longer candidates,
+	// and every location that can reach a newly assigned city must be re-evaluated
+	markLocationDirty(bestActions.loc);
+	forEachConflictingLocation(bestActions.loc, [&](const uint32_t l) {
+		markLocationDirty(l);
+	});
+
+	// same assignments as tryAddGreedy, the state has not changed since the evaluation
 	const uint32_t* ptr = getCitiesSorted(bestActions.loc);
-	for (uint32_t ci=0;ci<mNumCities;++ci) {
+	const uint32_t numPrimary = getNumCitiesInRange(bestActions.loc, bestActions.type, 0);
+	for (uint32_t ci = 0; ci < bestActions.cutoff; ++ci) {
 		uint32_t c = *(ptr + ci);
-		if (bestActions.assigns[ci] == 1) {
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED && ci < numPrimary) {
 			mCityCenterAssignment[c].first = bestActions.loc;
+			mCenterServing[bestActions.loc] += mBaseModel.getCities()[c].population * 10;
 		}
-		else if (bestActions.assigns[ci] == 2) {
+		else if (mCityCenterAssignment[c].second == NOT_ASSIGNED) {
 			mCityCenterAssignment[c].second = bestActions.loc;
+			mCenterServing[bestActions.loc] += mBaseModel.getCities()[c].population;
 		}
-		else if (bestActions.assigns[ci] == 3) {
-			break;
+		else {
+			continue;
 		}
+		mInstance->getLocationGrid().forEachInRadius(mBaseModel.getCities()[c].cityPos, mInstance->getReachDist(), [&](const uint32_t l) {
+			markLocationDirty(l);
+		});
 	}
-	mLocationTypeAssignment[bestActions.loc] = bestActions.type;
+	setLocationType(bestActions.loc, bestActions.type);
+	updateExpLoad(bestActions.loc);
 }
 
 void GreedyModel::runParallelLocalSearch()
 {
-	const int processor_count = std::thread::hardware_concurrency();
-	int perThread = static_cast<int>((std::ceil(static_cast<float>(mNumLocations) / processor_count)));
-	if (perThread < 1) perThread = 1;
-	std::vector<Swap> bestSwaps(processor_count);
-	int iter = 10000;
+	resetLoads();
+	uint32_t iter = mMaxSwaps;
 	uint32_t noImprovement = 0;
 	float oldFit = 0;
-	while (iter-- && noImprovement<5) {
-		Swap bestSwap = findBestSwap(bestSwaps, perThread, processor_count);
+	while (iter-- && noImprovement < mMaxNonImproving && std::chrono::steady_clock::now() < mDeadline) {
+		Swap bestSwap = findBestSwap();
 		if (bestSwap.fit <= 0) break;
 		else if (oldFit >= bestSwap.fit) noImprovement++;
 		else noImprovement = 0;
 		oldFit = bestSwap.fit;
 		applySwap(bestSwap);
 	}
-	trimLocations();
+	// closing or downgrading centers cannot fix a center set proven infeasible
+	mLastRepair = repairAssignment();
+	if (mLastRepair != RepairResult::Infeasible) {
+		trimLocations();
+	}
 }
 
 void GreedyModel::trimLocations() {
-	std::vector<float> centerServing(mNumCities, 0);
+	// a center left with only cities without population hands them to centers
+	// that serve some load, so that it can close without leaving them unassigned
+	std::vector<Reassignment> plan;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		if (mCenterServing[l] != 0.0f) {
+			return;
+		}
+		plan.clear();
+		bool movable = true;
+		forEachServedCity(l, [&](const uint32_t c, const bool primary) {
+			const uint32_t other = primary ? mCityCenterAssignment[c].second : mCityCenterAssignment[c].first;
+			const uint32_t* reaching = getLocationsInReach(c);
+			const uint32_t numReaching = getNumLocationsInReach(c);
+			uint32_t target = NOT_ASSIGNED;
+			for (uint32_t li = 0; li < numReaching && target == NOT_ASSIGNED; ++li) {
+				const uint32_t l2 = reaching[li];
+				if (l2 != other && isLocationOpen(l2) && mCenterServing[l2] != 0.0f && isCityLocationTypeCompatible(c, l2, mLocationTypeAssignment[l2], primary ? 0 : 1)) {
+					target = l2;
+				}
+			}
+			movable = movable && target != NOT_ASSIGNED;
+			plan.push_back({ c, primary, target });
+		});
+		if (movable) {
+			for (const Reassignment& r : plan) {
+				(r.primary ? mCityCenterAssignment[r.city].first : mCityCenterAssignment[r.city].second) = r.location;
+			}
+		}
+	});
+
+	const std::vector<float>& centerServing = mCenterServing;
 	std::vector<float> maxDistLoc(mNumLocations, 0);
 	std::vector<float> maxDistLocSec(mNumLocations, 0);
+	// cities without population add no load, so only these tell an empty center
+	std::vector<uint32_t> servedCities(mNumLocations, 0);
 	for (uint32_t i = 0; i < mCityCenterAssignment.size(); ++i) {
 		if (mCityCenterAssignment[i].first != NOT_ASSIGNED) {
+			++servedCities[mCityCenterAssignment[i].first];
 			vec2 position=mBaseModel.getCities()[i].cityPos;
 			float dist = mBaseModel.getLocations()[mCityCenterAssignment[i].first].sqDist(position);
 			if (dist > maxDistLoc[mCityCenterAssignment[i].first]) maxDistLoc[mCityCenterAssignment[i].first] = dist;
-			centerServing[mCityCenterAssignment[i].first] += mBaseModel.getCities()[i].population * 10;
 		}
 		if (mCityCenterAssignment[i].second != NOT_ASSIGNED) {
+			++servedCities[mCityCenterAssignment[i].second];
 			vec2 position = mBaseModel.getCities()[i].cityPos;
 			float dist = mBaseModel.getLocations()[mCityCenterAssignment[i].second].sqDist(position);
 			if (dist > maxDistLocSec[mCityCenterAssignment[i].second]) maxDistLocSec[mCityCenterAssignment[i].second] = dist;
-			centerServing[mCityCenterAssignment[i].second] += mBaseModel.getCities()[i].population;
 		}
 
 	}
@@ -213,13 +321,13 @@ void GreedyModel::trimLocations() {
 		uint32_t bestType = type;
 		if (type != NOT_ASSIGNED) {
 			float bestCost = mBaseModel.getCenterTypes()[type].cost;
-			if (centerServing[cl] == 0.0f) {
+			if (servedCities[cl] == 0) {
 				bestType = NOT_ASSIGNED;
 			}
 			else {
 				for (uint32_t t = 0; t < mNumTypes; ++t) {
 					if (type != t) {
-						if (mBaseModel.getCenterTypes()[t].maxPop >= centerServing[cl] && mBaseModel.getCenterTypes()[t].serveDist>=maxDistLoc[cl] && mBaseModel.getCenterTypes()[t].serveDist>=3* maxDistLocSec[cl]) {
+						if (mBaseModel.getCenterTypes()[t].maxPop * 10.0f >= centerServing[cl] && maxDistLoc[cl] <= mInstance->getSquaredServeDist(t, 0) && maxDistLocSec[cl] <= mInstance->getSquaredServeDist(t, 1)) {
 							if (bestCost > mBaseModel.getCenterTypes()[t].cost) {
 								bestCost = mBaseModel.getCenterTypes()[t].cost;
 								bestType = t;
@@ -229,237 +337,1022 @@ void GreedyModel::trimLocations() {
 				}
 			}
 		}
-		mLocationTypeAssignment[cl] = bestType;
+		if (mLocationTypeAssignment[cl] != bestType) {
+			setLocationType(cl, bestType);
+			updateExpLoad(cl);
+		}
 	}
 }
 
 void GreedyModel::applySwap(Swap bestSwap) {
-	if (bestSwap.primarySwap) {
-		mCityCenterAssignment[bestSwap.city].first = bestSwap.location;
-	}
-	else if (!bestSwap.primarySwap){
-		mCityCenterAssignment[bestSwap.city].second = bestSwap.location;
-	}
+	AMM_COUNT(SwapsApplied, 1);
+	const float population = static_cast<float>(mBaseModel.getCities()[bestSwap.city].population);
+	uint32_t& assigned = bestSwap.primarySwap ? mCityCenterAssignment[bestSwap.city].first : mCityCenterAssignment[bestSwap.city].second;
+	const float weight = bestSwap.primarySwap ? 10.0f : 1.0f;
 
+	if (assigned != NOT_ASSIGNED) {
+		mCenterServing[assigned] -= weight * population;
+		updateExpLoad(assigned);
+	}
+	assigned = bestSwap.location;
+	mCenterServing[assigned] += weight * population;
+	updateExpLoad(assigned);
 }
 
-float getLoad(std::vector<float> centerServing, uint32_t location, uint32_t maxPop) {
-	return centerServing[location] / maxPop;
-}
-
-
-double GreedyModel::getUsefulLoad(std::vector<float> centerServing) {
-	double usefulLoad = 0;
-	uint32_t loc = 0;
-	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		if (centerServing[l] != 0) {
-			uint32_t type = mLocationTypeAssignment[l];
-			double load = static_cast<double> (centerServing[l]) / static_cast<double> (mBaseModel.getCenterTypes()[type].maxPop*10);
-			double expLoad = exp(load);
-			usefulLoad += expLoad;
-		}
+void GreedyModel::updateExpLoad(const uint32_t l)
+{
+	double expLoad = 0.0;
+	if (mCenterServing[l] != 0 && mLocationTypeAssignment[l] != NOT_ASSIGNED) {
+		uint32_t type = mLocationTypeAssignment[l];
+		double load = static_cast<double> (mCenterServing[l]) / static_cast<double> (mBaseModel.getCenterTypes()[type].maxPop*10);
+		expLoad = exp(load);
 	}
-	return usefulLoad;
+	mUsefulLoad += expLoad - mCenterExpLoad[l];
+	mCenterExpLoad[l] = expLoad;
 }
 
-GreedyModel::Swap GreedyModel::findBestSwap(std::vector<Swap> bestSwaps, uint32_t perThread, int processor_count)
+void GreedyModel::resetLoads()
 {
-
-	std::vector<float> centerServing(mNumCities,0);
+	std::fill(mCenterServing.begin(), mCenterServing.end(), 0.0f);
 	for (uint32_t i = 0; i < mCityCenterAssignment.size(); ++i) {
-		if (mCityCenterAssignment[i].first!=NOT_ASSIGNED) {
-			centerServing[mCityCenterAssignment[i].first] += mBaseModel.getCities()[i].population*10;
+		if (mCityCenterAssignment[i].first != NOT_ASSIGNED) {
+			mCenterServing[mCityCenterAssignment[i].first] += mBaseModel.getCities()[i].population * 10;
 		}
 		if (mCityCenterAssignment[i].second != NOT_ASSIGNED) {
-			centerServing[mCityCenterAssignment[i].second] += mBaseModel.getCities()[i].population;
+			mCenterServing[mCityCenterAssignment[i].second] += mBaseModel.getCities()[i].population;
 		}
 	}
-	#pragma omp parallel num_threads(processor_count)
-	{
+	// summed from scratch, so that rounding errors do not accumulate
+	std::fill(mCenterExpLoad.begin(), mCenterExpLoad.end(), 0.0);
+	mUsefulLoad = 0.0;
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		updateExpLoad(l);
+	}
+}
 
-		const int c = omp_get_thread_num();
-		Swap bestSwap;
-		bestSwap.fit = 0;
-		std::vector<City> cities = mBaseModel.getCities();
-		for (uint32_t ci = c * perThread; ci < (c + 1) * perThread && ci < mNumCities; ++ci) {
-			City current = cities[ci];
-			uint32_t locationPrimary = mCityCenterAssignment[ci].first;
-			uint32_t locationSecondary = mCityCenterAssignment[ci].second;
-			double usefulLoad = getUsefulLoad(centerServing);
-			for (uint32_t cl = 0; cl < mNumLocations; ++cl) {
-				if (mLocationTypeAssignment[cl]!=NOT_ASSIGNED) {
-					float destiny = centerServing.at(cl);
-					if (locationSecondary == NOT_ASSIGNED &&  (cl!=locationPrimary)) {
-						if ((isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 1)) && ((destiny + current.population) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
-							Swap aux;
-							aux.location = cl;
-							aux.city = ci;
-							double newLoadDestiny = (destiny + current.population * 10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-							double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-							newLoadDestiny = exp(newLoadDestiny);
-							oldLoadDestiny = exp(oldLoadDestiny);
-							double newUsefulLoad = usefulLoad - oldLoadDestiny + newLoadDestiny;
-							aux.fit = newUsefulLoad +EulerConstant*mNumLocations;
-							aux.primarySwap = false;
-							bestSwap = aux;
-						}
+GreedyModel::Swap GreedyModel::findBestSwap() const
+{
+	// total order used by the parallel argmax
+	auto isBetterSwap = [](const Swap& a, const Swap& b) -> bool {
+		if (a.fit != b.fit) return a.fit > b.fit;
+		if (a.city != b.city) return a.city < b.city;
+		if (a.location != b.location) return a.location < b.location;
+		return a.primarySwap && !b.primarySwap;
+	};
+
+	const std::vector<float>& centerServing = mCenterServing;
+	const double usefulLoad = mUsefulLoad;
+	const ArrayView<City> cities = mBaseModel.getCities();
+
+	Swap noSwap;
+	noSwap.fit = 0;
+	noSwap.city = NOT_ASSIGNED;
+	noSwap.location = NOT_ASSIGNED;
+	noSwap.primarySwap = false;
+
+	auto evaluateCity = [&](const int i, Swap& bestSwap) {
+		const uint32_t ci = static_cast<uint32_t>(i);
+		const City& current = cities[ci];
+		uint32_t locationPrimary = mCityCenterAssignment[ci].first;
+		uint32_t locationSecondary = mCityCenterAssignment[ci].second;
+		auto consider = [&](const uint32_t cl, const double fit, const bool primarySwap) {
+			AMM_COUNT(SwapsEvaluated, 1);
+			Swap aux;
+			aux.location = cl;
+			aux.city = ci;
+			aux.fit = static_cast<float>(fit);
+			aux.primarySwap = primarySwap;
+			if (isBetterSwap(aux, bestSwap)) {
+				bestSwap = aux;
+			}
+		};
+		// only the locations in reach can be compatible with the city
+		const uint32_t* reaching = getLocationsInReach(ci);
+		const uint32_t numReaching = getNumLocationsInReach(ci);
+		for (uint32_t li = 0; li < numReaching; ++li) {
+			const uint32_t cl = reaching[li];
+			if (mLocationTypeAssignment[cl]!=NOT_ASSIGNED) {
+				float destiny = centerServing[cl];
+				if (locationSecondary == NOT_ASSIGNED &&  (cl!=locationPrimary)) {
+					if ((isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 1)) && ((destiny + current.population) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
+						double newLoadDestiny = (destiny + current.population * 10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						newLoadDestiny = exp(newLoadDestiny);
+						oldLoadDestiny = exp(oldLoadDestiny);
+						double newUsefulLoad = usefulLoad - oldLoadDestiny + newLoadDestiny;
+						consider(cl, newUsefulLoad + EulerConstant * mNumLocations, false);
 					}
-					if (locationPrimary == NOT_ASSIGNED && (locationSecondary!=cl)) {
-						if ((isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 0)) && ((destiny + current.population*10) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
-							Swap aux;
-							aux.location = cl;
-							aux.city = ci;
-							double newLoadDestiny = (destiny + current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-							double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-							newLoadDestiny = exp(newLoadDestiny);
-							oldLoadDestiny = exp(oldLoadDestiny);
-							double newUsefulLoad = usefulLoad - oldLoadDestiny + newLoadDestiny;
-							aux.fit = newUsefulLoad/2 + EulerConstant * mNumLocations;
-							aux.primarySwap = true;
-							bestSwap = aux;
-						}
+				}
+				if (locationPrimary == NOT_ASSIGNED && (locationSecondary!=cl)) {
+					if ((isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 0)) && ((destiny + current.population*10) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
+						double newLoadDestiny = (destiny + current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						newLoadDestiny = exp(newLoadDestiny);
+						oldLoadDestiny = exp(oldLoadDestiny);
+						double newUsefulLoad = usefulLoad - oldLoadDestiny + newLoadDestiny;
+						consider(cl, newUsefulLoad / 2 + EulerConstant * mNumLocations, true);
+					}
+				}
+				if (locationPrimary != NOT_ASSIGNED && isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 0) && (cl != locationSecondary)) {
+					float origin = centerServing[locationPrimary];
+					if (((destiny + current.population*10) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
+						double newLoadDestiny = (destiny + current.population*10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						double newLoadOrigin = (origin - current.population*10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationPrimary]].maxPop * 10);
+						double oldLoadOrigin = origin / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationPrimary]].maxPop * 10);
+						double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
+						newLoadDestiny = exp(newLoadDestiny);
+						newLoadOrigin = exp(newLoadOrigin);
+						oldLoadOrigin = exp(oldLoadOrigin);
+						oldLoadDestiny = exp(oldLoadDestiny);
+
+						double loadChange = -((oldLoadOrigin) + (oldLoadDestiny)) + ((newLoadDestiny) + (newLoadOrigin));
+						consider(cl, usefulLoad + loadChange, true);
+					}
+				}
+				if (locationSecondary != NOT_ASSIGNED && isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 1) && (cl != locationPrimary)) {
+					float origin = centerServing[locationSecondary];
+					if (( (destiny + current.population ) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
+						double newLoadDestiny = (destiny + current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10);
+						double newLoadOrigin = (origin - current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationSecondary]].maxPop*10);
+						double oldLoadOrigin = origin / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationSecondary]].maxPop*10);
+						double oldLoadDestiny= destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10);
+						newLoadDestiny = exp(newLoadDestiny);
+						newLoadOrigin = exp(newLoadOrigin);
+						oldLoadOrigin = exp(oldLoadOrigin);
+						oldLoadDestiny = exp(oldLoadDestiny);
+						double loadChange = -((oldLoadOrigin) + (oldLoadDestiny)) + ((newLoadDestiny) + (newLoadOrigin));
+						consider(cl, usefulLoad + loadChange, false);
 					}
-					if (locationPrimary != NOT_ASSIGNED && isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 0) && (cl != locationSecondary)) {
-							float destiny = centerServing.at(cl);
-							float origin = centerServing.at(locationPrimary);
-							if (((destiny + current.population*10) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
-								double newLoadDestiny = (destiny + current.population*10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-								double newLoadOrigin = (origin - current.population*10) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationPrimary]].maxPop * 10);
-								double oldLoadOrigin = origin / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationPrimary]].maxPop * 10);
-								double oldLoadDestiny = destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop * 10);
-								newLoadDestiny = exp(newLoadDestiny);
-								newLoadOrigin = exp(newLoadOrigin);
-								oldLoadOrigin = exp(oldLoadOrigin);
-								oldLoadDestiny = exp(oldLoadDestiny);
-
-								double loadChange = -((oldLoadOrigin) + (oldLoadDestiny)) + ((newLoadDestiny) + (newLoadOrigin));
-								double newUsefulLoad = usefulLoad + loadChange;
-								if (bestSwap.fit < newUsefulLoad) {
-									Swap aux;
-									aux.location = cl;
-									aux.city = ci;
-									aux.fit = newUsefulLoad;
-									aux.primarySwap = true;
-									bestSwap = aux;
-								}
-							}
-						}
-					if (locationSecondary != NOT_ASSIGNED && isCityLocationTypeCompatible(ci, cl, mLocationTypeAssignment[cl], 1) && (cl != locationPrimary)) {
-							float destiny = centerServing.at(cl);
-							float origin = centerServing.at(locationSecondary);
-							if (( (destiny + current.population ) <= mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10)) {
-								double newLoadDestiny = (destiny + current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10);
-								double newLoadOrigin = (origin - current.population) / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationSecondary]].maxPop*10);
-								double oldLoadOrigin = origin / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[locationSecondary]].maxPop*10);
-								double oldLoadDestiny= destiny / (mBaseModel.getCenterTypes()[mLocationTypeAssignment[cl]].maxPop*10);
-								newLoadDestiny = exp(newLoadDestiny);
-								newLoadOrigin = exp(newLoadOrigin);
-								oldLoadOrigin = exp(oldLoadOrigin);
-								oldLoadDestiny = exp(oldLoadDestiny);
-								double loadChange = -((oldLoadOrigin) + (oldLoadDestiny)) + ((newLoadDestiny) + (newLoadOrigin));
-								double newUsefulLoad = usefulLoad + loadChange;
-								if (bestSwap.fit < newUsefulLoad) {
-									Swap aux;
-									aux.location = cl;
-									aux.city = ci;
-									aux.fit = newUsefulLoad;
-									aux.primarySwap = false;
-									bestSwap = aux;
-								}
-							}
-						}
 				}
 			}
 		}
-		bestSwaps[omp_get_thread_num()] = bestSwap;
-	}
-	float bestFit = -std::numeric_limits<float>::infinity();
-	int bestPos = 0;
-	for (int i = 0; i < processor_count; ++i) {
-		//std::cout << bestSwaps[i].fit << std::endl;
-		if (bestSwaps[i].fit > bestFit) {
-			bestFit = bestSwaps[i].fit;
-			bestPos = i;
-		}
-	}
-	return std::move(bestSwaps[bestPos]);
+	};
+
+	return parallelReduce(static_cast<int>(mNumCities), mNumThreads, noSwap, evaluateCity,
+		[&](Swap& best, const Swap& other) {
+			if (isBetterSwap(other, best)) {
+				best = other;
+			}
+		},
+		16);
 }
-void GreedyModel::GRASPConstructivePhase(float alpha) {
-	std::vector<Candidate> candidateList(mNumTypes * mNumLocations);
-	std::vector<Candidate> RCL(mNumTypes * mNumLocations);
-	const int processor_count = std::thread::hardware_concurrency();
-	int perThread = static_cast<int>((std::ceil(static_cast<float>(mNumLocations) / processor_count)));
-	if (perThread < 1) perThread = 1;
-	std::vector<std::vector<char>> assignments(processor_count,std::vector<char>(mNumCities));
+bool GreedyModel::GRASPConstructivePhase(float alpha) {
+	std::vector<uint32_t> RCL(mNumTypes * mNumLocations);
+	markAllLocationsDirty();
 	while (!isSolutionFast()) {
-		Candidate GRASPCandidate = findCandidateGRASP(candidateList, RCL, assignments,perThread, processor_count, alpha);
+		if (std::chrono::steady_clock::now() >= mDeadline) {
+			return false;
+		}
+		Candidate GRASPCandidate = findCandidateGRASP(RCL, alpha);
 		if (GRASPCandidate.fit == -std::numeric_limits<float>::infinity()) break;
 		applyAction(GRASPCandidate);
 	}	
+	return true;
 }
 
 void GreedyModel::purge() {
 	for (uint32_t l = 0; l < mNumLocations; ++l) {
-		mLocationTypeAssignment[l] = NOT_ASSIGNED;
+		setLocationType(l, NOT_ASSIGNED);
 	}
 	for (uint32_t c = 0; c < mNumCities; ++c) {
 		mCityCenterAssignment[c].first = NOT_ASSIGNED;
 		mCityCenterAssignment[c].second = NOT_ASSIGNED;
 	}
+	std::fill(mCenterServing.begin(), mCenterServing.end(), 0.0f);
+	std::fill(mCenterExpLoad.begin(), mCenterExpLoad.end(), 0.0);
+	mUsefulLoad = 0.0;
 
 }
 
-GreedyModel::Candidate GreedyModel::findCandidateGRASP(std::vector<GreedyModel::Candidate> &candidates, std::vector<Candidate> &RCL, std::vector<std::vector<char>> &assignments , uint32_t perThread, int processor_count, float alpha) const
+void GreedyModel::setSolution(const Solution& solution)
 {
+	IModel::setSolution(solution);
+	resetLoads();
+	markAllLocationsDirty();
+}
 
-std::vector<float> bestFits(processor_count);
-std::vector<float> worstFits(processor_count);
+GreedyModel::Candidate GreedyModel::findCandidateGRASP(std::vector<uint32_t> &RCL, float alpha)
+{
+	refreshCandidates();
 
-#pragma omp parallel num_threads(processor_count)
-	{
-		const int c = omp_get_thread_num();
+	// best fit and worst feasible fit
+	auto extend = [](std::pair<float, float>& range, const float fit) {
+		if (fit > range.first) {
+			range.first = fit;
+		}
+		if (fit != -std::numeric_limits<float>::infinity() && fit < range.second) {
+			range.second = fit;
+		}
+	};
+	const std::pair<float, float> fitRange = parallelReduce(static_cast<int>(mAvailableLocations.size() * mNumTypes), mNumThreads,
+		std::make_pair(-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()),
+		[&](const int i, std::pair<float, float>& range) { extend(range, mCandidates[availableCandidate(i)].fit); },
+		[](std::pair<float, float>& range, const std::pair<float, float>& other) {
+			range.first = std::max(range.first, other.first);
+			range.second = std::min(range.second, other.second);
+		},
+		4096);
+	const float bestFit = fitRange.first;
+	const float worstFit = fitRange.second;
+	if (bestFit == -std::numeric_limits<float>::infinity()) {
+		return mCandidates[0];
+	}
+	float cutoff = bestFit-((bestFit-worstFit) * alpha);
+	uint32_t iter = 0;
+	for (uint32_t i = 0; i < mAvailableLocations.size() * mNumTypes; ++i) {
+		const uint32_t candidate = availableCandidate(i);
+		if (mCandidates[candidate].fit >= cutoff) {
+			RCL[iter] = candidate;
+			iter++;
+		}
+	}
+	// the random choice does not depend on the order of the available locations
+	std::sort(RCL.begin(), RCL.begin() + iter);
+	uint32_t randElec = mRng() % iter;
+	return mCandidates[RCL[randElec]];
+}
+void GreedyModel::updateServedSqDist(const uint32_t l)
+{
+	float primarySqDist = 0.0f;
+	float secondarySqDist = 0.0f;
+	if (mLocationTypeAssignment[l] != NOT_ASSIGNED) {
+		const vec2 position = mBaseModel.getLocations()[l];
+		forEachServedCity(l, [&](const uint32_t c, const bool primary) {
+			float& sqDist = primary ? primarySqDist : secondarySqDist;
+			sqDist = std::max(sqDist, position.sqDist(mBaseModel.getCities()[c].cityPos));
+		});
+	}
+	mServedSqDist[2 * l] = primarySqDist;
+	mServedSqDist[2 * l + 1] = secondarySqDist;
+}
+
+uint32_t GreedyModel::cheapestType(const float load, const float primarySqDist, const float secondarySqDist, const float maxCost) const
+{
+	uint32_t bestType = NOT_ASSIGNED;
+	float bestCost = maxCost;
+	for (uint32_t t = 0; t < mNumTypes; ++t) {
+		const CenterType& type = mBaseModel.getCenterTypes()[t];
+		if (type.cost < bestCost && load <= type.maxPop * 10 &&
+			primarySqDist <= mInstance->getSquaredServeDist(t, 0) && secondarySqDist <= mInstance->getSquaredServeDist(t, 1)) {
+			bestType = t;
+			bestCost = type.cost;
+		}
+	}
+	return bestType;
+}
+
+bool GreedyModel::planClose(const uint32_t center, std::vector<Reassignment>& plan, std::vector<std::pair<uint32_t, uint32_t>>& upgrades, float& delta) const
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+
+	plan.clear();
+	forEachServedCity(center, [&](const uint32_t c, const bool primary) {
+		plan.push_back({ c, primary, NOT_ASSIGNED });
+	});
+	auto demand = [&](const Reassignment& r) -> float {
+		return static_cast<float>(cities[r.city].population) * (r.primary ? 10.0f : 1.0f);
+	};
+	// the biggest demands first, they are the hardest to place
+	std::sort(plan.begin(), plan.end(), [&](const Reassignment& a, const Reassignment& b) {
+		if (demand(a) != demand(b)) return demand(a) > demand(b);
+		if (a.city != b.city) return a.city < b.city;
+		return a.primary && !b.primary;
+	});
+
+	std::vector<Receiver>& receivers = getMoveScratch().receivers;
+	receivers.clear();
+	auto receiverAt = [&](const uint32_t l) -> Receiver {
+		for (const Receiver& r : receivers) {
+			if (r.location == l) {
+				return r;
+			}
+		}
+		return { l, mLocationTypeAssignment[l], mCenterServing[l], { mServedSqDist[2 * l], mServedSqDist[2 * l + 1] } };
+	};
+
+	for (Reassignment& r : plan) {
+		const uint32_t role = r.primary ? 0 : 1;
+		const uint32_t other = r.primary ? mCityCenterAssignment[r.city].second : mCityCenterAssignment[r.city].first;
+		const vec2 position = cities[r.city].cityPos;
+
+		// the cheapest upgrade, then the most capacity left
+		Receiver best = {};
+		float bestExtra = std::numeric_limits<float>::infinity();
+		float bestSpare = 0.0f;
+		const uint32_t* reaching = getLocationsInReach(r.city);
+		const uint32_t numReaching = getNumLocationsInReach(r.city);
+		for (uint32_t li = 0; li < numReaching; ++li) {
+			const uint32_t l = reaching[li];
+			if (l == center || l == other || !isLocationOpen(l)) {
+				continue;
+			}
+			Receiver receiver = receiverAt(l);
+			const uint32_t oldType = receiver.type;
+			receiver.load += demand(r);
+			receiver.sqDist[role] = std::max(receiver.sqDist[role], mBaseModel.getLocations()[l].sqDist(position));
+			if (receiver.load > types[receiver.type].maxPop * 10 || !isCityLocationTypeCompatible(r.city, l, receiver.type, role)) {
+				receiver.type = cheapestType(receiver.load, receiver.sqDist[0], receiver.sqDist[1], std::numeric_limits<float>::infinity());
+				if (receiver.type == NOT_ASSIGNED || !isCityLocationTypeCompatible(r.city, l, receiver.type, role)) {
+					continue;
+				}
+			}
+			const float extra = types[receiver.type].cost - types[oldType].cost;
+			const float spare = types[receiver.type].maxPop * 10 - receiver.load;
+			if (extra < bestExtra || (extra == bestExtra && spare > bestSpare)) {
+				best = receiver;
+				bestExtra = extra;
+				bestSpare = spare;
+			}
+		}
+		if (bestExtra == std::numeric_limits<float>::infinity()) {
+			return false;
+		}
+
+		r.location = best.location;
+		bool found = false;
+		for (Receiver& receiver : receivers) {
+			if (receiver.location == best.location) {
+				receiver = best;
+				found = true;
+			}
+		}
+		if (!found) {
+			receivers.push_back(best);
+		}
+	}
+
+	delta = -types[mLocationTypeAssignment[center]].cost;
+	upgrades.clear();
+	for (const Receiver& receiver : receivers) {
+		if (receiver.type != mLocationTypeAssignment[receiver.location]) {
+			delta += types[receiver.type].cost - types[mLocationTypeAssignment[receiver.location]].cost;
+			upgrades.push_back({ receiver.location, receiver.type });
+		}
+	}
+	return true;
+}
+
+GreedyModel::Move GreedyModel::planRelocation(const uint32_t center) const
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	const uint32_t type = mLocationTypeAssignment[center];
+
+	Move best;
+	best.delta = 0.0f;
+	best.kind = MoveKind::Relocate;
+	best.center = center;
+	best.location = NOT_ASSIGNED;
+	best.type = NOT_ASSIGNED;
+
+	std::vector<std::pair<uint32_t, bool>>& served = getMoveScratch().served;
+	served.clear();
+	forEachServedCity(center, [&](const uint32_t c, const bool primary) {
+		served.push_back({ c, primary });
+	});
+	// a center without cities is closed instead
+	if (served.empty()) {
+		return best;
+	}
+
+	// the new location must reach every city, in particular the first one
+	const uint32_t* reaching = getLocationsInReach(served[0].first);
+	const uint32_t numReaching = getNumLocationsInReach(served[0].first);
+	for (uint32_t li = 0; li < numReaching; ++li) {
+		const uint32_t l = reaching[li];
+		// free once center is closed
+		if (l == center || isLocationOpen(l) || mBlockedCount[l] != (isLocationPairCompatible(center, l) ? 0u : 1u)) {
+			continue;
+		}
+		float sqDist[2] = { 0.0f, 0.0f };
+		for (const std::pair<uint32_t, bool>& city : served) {
+			float& d = sqDist[city.second ? 0 : 1];
+			d = std::max(d, mBaseModel.getLocations()[l].sqDist(cities[city.first].cityPos));
+		}
+		const uint32_t newType = cheapestType(mCenterServing[center], sqDist[0], sqDist[1], types[type].cost + best.delta);
+		if (newType == NOT_ASSIGNED) {
+			continue;
+		}
+		bool compatible = true;
+		for (const std::pair<uint32_t, bool>& city : served) {
+			compatible = compatible && isCityLocationTypeCompatible(city.first, l, newType, city.second ? 0 : 1);
+		}
+		if (compatible) {
+			best.delta = types[newType].cost - types[type].cost;
+			best.location = l;
+			best.type = newType;
+		}
+	}
+	return best;
+}
+
+GreedyModel::MoveScratch& GreedyModel::getMoveScratch() const
+{
+	return mMoveScratch[omp_get_thread_num()];
+}
+
+GreedyModel::Move GreedyModel::evaluateMove(const MoveKind kind, const uint32_t center) const
+{
+	Move move;
+	move.delta = 0.0f;
+	move.kind = kind;
+	move.center = center;
+	move.location = NOT_ASSIGNED;
+	move.type = NOT_ASSIGNED;
+	if (kind == MoveKind::TypeChange) {
+		const float cost = mBaseModel.getCenterTypes()[mLocationTypeAssignment[center]].cost;
+		move.type = cheapestType(mCenterServing[center], mServedSqDist[2 * center], mServedSqDist[2 * center + 1], cost);
+		bool compatible = move.type != NOT_ASSIGNED;
+		forEachServedCity(center, [&](const uint32_t c, const bool primary) {
+			compatible = compatible && isCityLocationTypeCompatible(c, center, move.type, primary ? 0 : 1);
+		});
+		if (compatible) {
+			move.delta = mBaseModel.getCenterTypes()[move.type].cost - cost;
+		}
+	}
+	else if (kind == MoveKind::Close) {
+		MoveScratch& scratch = getMoveScratch();
+		float delta;
+		if (planClose(center, scratch.plan, scratch.upgrades, delta)) {
+			move.delta = delta;
+		}
+	}
+	else {
+		move = planRelocation(center);
+	}
+	return move;
+}
+
+std::vector<GreedyModel::Move> GreedyModel::findImprovingMoves(const MoveKind kind) const
+{
+	std::vector<uint32_t> openCenters;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		openCenters.push_back(l);
+	});
+
+	std::vector<Move> moves(openCenters.size());
+	parallelFor(static_cast<int>(openCenters.size()), mNumThreads, [&](const int i) {
+		moves[i] = evaluateMove(kind, openCenters[i]);
+	});
+
+	// best first, ties by center
+	moves.erase(std::remove_if(moves.begin(), moves.end(), [](const Move& move) { return !(move.delta < 0); }), moves.end());
+	std::sort(moves.begin(), moves.end(), [](const Move& a, const Move& b) {
+		if (a.delta != b.delta) return a.delta < b.delta;
+		return a.center < b.center;
+	});
+	return moves;
+}
+
+void GreedyModel::applyMove(const Move& move)
+{
+	const uint32_t center = move.center;
+	if (move.kind == MoveKind::TypeChange) {
+		setLocationType(center, move.type);
+		updateExpLoad(center);
+		return;
+	}
+
+	MoveScratch& scratch = getMoveScratch();
+	std::vector<Reassignment>& plan = scratch.plan;
+	std::vector<std::pair<uint32_t, uint32_t>>& upgrades = scratch.upgrades;
+	plan.clear();
+	upgrades.clear();
+	if (move.kind == MoveKind::Close) {
+		float delta;
+		planClose(center, plan, upgrades, delta);
+	}
+	else {
+		forEachServedCity(center, [&](const uint32_t c, const bool primary) {
+			plan.push_back({ c, primary, move.location });
+		});
+		upgrades.push_back({ move.location, move.type });
+	}
+
+	// closed before the relocated center opens, so that it does not block it
+	setLocationType(center, NOT_ASSIGNED);
+	for (const std::pair<uint32_t, uint32_t>& upgrade : upgrades) {
+		setLocationType(upgrade.first, upgrade.second);
+	}
+	for (const Reassignment& r : plan) {
+		const float population = static_cast<float>(mBaseModel.getCities()[r.city].population);
+		uint32_t& assigned = r.primary ? mCityCenterAssignment[r.city].first : mCityCenterAssignment[r.city].second;
+		assigned = r.location;
+		mCenterServing[r.location] += r.primary ? 10.0f * population : population;
+	}
+	mCenterServing[center] = 0.0f;
 
-		float bestFit= -std::numeric_limits<float>::infinity();
-		float worstFit= std::numeric_limits<float>::infinity();
+	std::vector<uint32_t> changed(1, center);
+	for (const Reassignment& r : plan) {
+		changed.push_back(r.location);
+	}
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	for (const uint32_t l : changed) {
+		updateExpLoad(l);
+		updateServedSqDist(l);
+	}
+}
 
-		for (uint32_t l = c * perThread; l < (c + 1) * perThread && l < mNumLocations; ++l) {
-			for (uint32_t t = 0; t < mNumTypes; ++t) {
-				Candidate currentCandidate = tryAddGreedy(l, t, assignments[c]);
-				candidates[l * mNumTypes + t] = currentCandidate;
-				if (currentCandidate.fit > bestFit) {
-					bestFit = currentCandidate.fit;
+// Variable neighbourhood descent: closes a center and moves its cities to other ones
+// (upgrading their type if needed), moves a center to a free location with a cheaper
+// type, or changes the type of a center. Every pass applies the improving moves of
+// the first neighbourhood with any, best first, and each applied move lowers the cost
+void GreedyModel::runNeighbourhoodDescent()
+{
+	mMoveScratch.resize(std::max(mMoveScratch.size(), static_cast<size_t>(mNumThreads)));
+	resetLoads();
+	mServedSqDist.assign(2 * static_cast<size_t>(mNumLocations), 0.0f);
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		updateServedSqDist(l);
+	});
+
+	// Back to the first neighbourhood after a pass that improves. The moves of a pass
+	// are found on the same state, so each one is evaluated again right before it is
+	// applied, after the better ones changed the centers around it
+	uint32_t iter = mMaxMoves;
+	uint32_t neighbourhood = 0;
+	while (neighbourhood < static_cast<uint32_t>(MoveKind::Count) && iter && std::chrono::steady_clock::now() < mDeadline) {
+		const MoveKind kind = static_cast<MoveKind>(neighbourhood);
+		bool improved = false;
+		for (const Move& found : findImprovingMoves(kind)) {
+			if (!iter || std::chrono::steady_clock::now() >= mDeadline) {
+				break;
+			}
+			if (!isLocationOpen(found.center)) {
+				continue;
+			}
+			const Move move = evaluateMove(kind, found.center);
+			if (move.delta < 0) {
+				applyMove(move);
+				--iter;
+				improved = true;
+			}
+		}
+		neighbourhood = improved ? 0 : neighbourhood + 1;
+	}
+}
+
+void GreedyModel::releaseCenter(const uint32_t l, std::vector<uint32_t>& released)
+{
+	if (!isLocationOpen(l)) {
+		return;
+	}
+	forEachServedCity(l, [&](const uint32_t c, const bool primary) {
+		(primary ? mCityCenterAssignment[c].first : mCityCenterAssignment[c].second) = NOT_ASSIGNED;
+		released.push_back(c);
+	});
+	mCenterServing[l] = 0.0f;
+	updateExpLoad(l);
+}
+
+void GreedyModel::moveToGuide(const uint32_t l, const Solution& guide, std::vector<uint32_t>& released)
+{
+	const uint32_t t = guide.locationTypes[l];
+	if (mLocationTypeAssignment[l] == t) {
+		return;
+	}
+	releaseCenter(l, released);
+	setLocationType(l, NOT_ASSIGNED);
+	if (t == NOT_ASSIGNED) {
+		updateExpLoad(l);
+		return;
+	}
+
+	// guide is feasible, so none of these centers is in it
+	forEachConflictingLocation(l, [&](const uint32_t l2) {
+		if (isLocationOpen(l2)) {
+			releaseCenter(l2, released);
+			setLocationType(l2, NOT_ASSIGNED);
+			updateExpLoad(l2);
+		}
+	});
+	setLocationType(l, t);
+
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const float maxLoad = mBaseModel.getCenterTypes()[t].maxPop * 10.0f;
+	const uint32_t* ptr = getCitiesSorted(l);
+	const uint32_t numSecondary = getNumCitiesInRange(l, t, 1);
+	for (uint32_t ci = 0; ci < numSecondary; ++ci) {
+		const uint32_t c = ptr[ci];
+		std::pair<uint32_t, uint32_t>& assigned = mCityCenterAssignment[c];
+		const bool primary = guide.cityCenters[c].first == l;
+		if (!primary && guide.cityCenters[c].second != l) {
+			continue;
+		}
+		const float demand = static_cast<float>(cities[c].population) * (primary ? 10.0f : 1.0f);
+		uint32_t& role = primary ? assigned.first : assigned.second;
+		const uint32_t other = primary ? assigned.second : assigned.first;
+		if (other == l || !isCityLocationTypeCompatible(c, l, t, primary ? 0 : 1) || mCenterServing[l] + demand > maxLoad) {
+			continue;
+		}
+		if (role != NOT_ASSIGNED) {
+			mCenterServing[role] -= demand;
+			updateExpLoad(role);
+		}
+		role = l;
+		mCenterServing[l] += demand;
+	}
+	updateExpLoad(l);
+}
+
+void GreedyModel::reassignReleased(const std::vector<uint32_t>& released, const Solution& guide)
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	auto fits = [&](const uint32_t c, const uint32_t l, const uint32_t isSecondary, const uint32_t other, const float demand) {
+		return l != NOT_ASSIGNED && l != other && isLocationOpen(l) && isCityLocationTypeCompatible(c, l, mLocationTypeAssignment[l], isSecondary) &&
+			mCenterServing[l] + demand <= types[mLocationTypeAssignment[l]].maxPop * 10.0f;
+	};
+
+	for (const uint32_t c : released) {
+		for (uint32_t isSecondary = 0; isSecondary < 2; ++isSecondary) {
+			uint32_t& role = isSecondary ? mCityCenterAssignment[c].second : mCityCenterAssignment[c].first;
+			const uint32_t other = isSecondary ? mCityCenterAssignment[c].first : mCityCenterAssignment[c].second;
+			if (role != NOT_ASSIGNED) {
+				continue;
+			}
+			const float demand = static_cast<float>(cities[c].population) * (isSecondary ? 1.0f : 10.0f);
+			uint32_t best = isSecondary ? guide.cityCenters[c].second : guide.cityCenters[c].first;
+			if (!fits(c, best, isSecondary, other, demand)) {
+				best = NOT_ASSIGNED;
+				float bestFill = -1.0f;
+				const uint32_t* reaching = getLocationsInReach(c);
+				const uint32_t numReaching = getNumLocationsInReach(c);
+				for (uint32_t li = 0; li < numReaching; ++li) {
+					const uint32_t l = reaching[li];
+					if (!fits(c, l, isSecondary, other, demand)) {
+						continue;
+					}
+					const float fill = (mCenterServing[l] + demand) / (types[mLocationTypeAssignment[l]].maxPop * 10.0f);
+					if (fill > bestFill) {
+						best = l;
+						bestFill = fill;
+					}
 				}
-				if (currentCandidate.fit != -std::numeric_limits<float>::infinity() && currentCandidate.fit < worstFit) {
-					worstFit = currentCandidate.fit;
+			}
+			if (best != NOT_ASSIGNED) {
+				role = best;
+				mCenterServing[best] += demand;
+				updateExpLoad(best);
+			}
+		}
+	}
+}
+
+// Every step gives a share of the locations that differ their type in guide and
+// closes the centers that conflict with them. The cities the guide serves from those
+// locations move there, and the cities left without a center go to their center in
+// guide or to the fullest open center with room. The greedy completes the assignment
+// and the local search polishes every intermediate solution, the best one also gets
+// the descent
+bool GreedyModel::runPathRelinking(const Solution& guide)
+{
+	std::vector<uint32_t> differing;
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		if (mLocationTypeAssignment[l] != guide.locationTypes[l]) {
+			differing.push_back(l);
+		}
+	}
+	std::shuffle(differing.begin(), differing.end(), mRng);
+	resetLoads();
+
+	// the last step would reach the guide, so it is not taken
+	const size_t stepSize = (differing.size() + PATH_RELINKING_STEPS - 1) / PATH_RELINKING_STEPS;
+	Solution best;
+	bool found = false;
+	std::vector<uint32_t> released;
+	for (size_t end = stepSize; end < differing.size() && std::chrono::steady_clock::now() < mDeadline; end += stepSize) {
+		released.clear();
+		for (size_t i = end - stepSize; i < end; ++i) {
+			moveToGuide(differing[i], guide, released);
+		}
+		reassignReleased(released, guide);
+		if (!GRASPConstructivePhase(0.0f)) {
+			break;
+		}
+		runParallelLocalSearch();
+		if (isSolution() && (!found || getCentersCost() < best.cost)) {
+			best = getSolution();
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+	setSolution(best);
+	runNeighbourhoodDescent();
+	return true;
+}
+
+bool GreedyModel::canServeAllRoles() const
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	float maxSqDist[2] = { 0.0f, 0.0f };
+	int64_t maxCapacity = 0;
+	for (uint32_t t = 0; t < mNumTypes; ++t) {
+		maxSqDist[0] = std::max(maxSqDist[0], mInstance->getSquaredServeDist(t, 0));
+		maxSqDist[1] = std::max(maxSqDist[1], mInstance->getSquaredServeDist(t, 1));
+		maxCapacity = std::max(maxCapacity, 10 * static_cast<int64_t>(types[t].maxPop));
+	}
+
+	// the flow only sees the cities with population, and not that the two centers of
+	// a city differ. The secondary range contains the primary one
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		uint32_t numPrimary = 0;
+		uint32_t numSecondary = 0;
+		const uint32_t* reaching = getLocationsInReach(c);
+		const uint32_t numReaching = getNumLocationsInReach(c);
+		for (uint32_t li = 0; li < numReaching; ++li) {
+			const uint32_t l = reaching[li];
+			if (!isLocationOpen(l)) {
+				continue;
+			}
+			const float sqDist = mBaseModel.getLocations()[l].sqDist(cities[c].cityPos);
+			numPrimary += sqDist <= maxSqDist[0] ? 1 : 0;
+			numSecondary += sqDist <= maxSqDist[1] ? 1 : 0;
+		}
+		if (numPrimary == 0 || numSecondary < 2) {
+			return false;
+		}
+	}
+
+	// source, sink, the primary and secondary of every city, then the open centers
+	const uint32_t source = 0;
+	const uint32_t sink = 1;
+	const uint32_t firstCenter = 2 + 2 * mNumCities;
+	std::vector<uint32_t> centerNode(mNumLocations, NOT_ASSIGNED);
+	uint32_t numNodes = firstCenter;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		centerNode[l] = numNodes++;
+	});
+
+	MaxFlow flow(numNodes);
+	int64_t demand = 0;
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		const int64_t population = cities[c].population;
+		if (population == 0) {
+			continue;
+		}
+		for (uint32_t isSecondary = 0; isSecondary < 2; ++isSecondary) {
+			const uint32_t node = 2 + 2 * c + isSecondary;
+			const int64_t roleDemand = isSecondary ? population : 10 * population;
+			flow.addEdge(source, node, roleDemand);
+			demand += roleDemand;
+			const uint32_t* reaching = getLocationsInReach(c);
+			const uint32_t numReaching = getNumLocationsInReach(c);
+			for (uint32_t li = 0; li < numReaching; ++li) {
+				const uint32_t l = reaching[li];
+				if (isLocationOpen(l) && mBaseModel.getLocations()[l].sqDist(cities[c].cityPos) <= maxSqDist[isSecondary]) {
+					flow.addEdge(node, centerNode[l], roleDemand);
 				}
 			}
 		}
-		bestFits[c] = bestFit;
-		worstFits[c] = worstFit;
 	}
-	float bestFit = -std::numeric_limits<float>::infinity();
-	float worstFit = std::numeric_limits<float>::infinity();
-	for (int i = 0; i < processor_count; ++i) {
-		if (bestFits[i] > bestFit) {
-			bestFit = bestFits[i];
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		flow.addEdge(centerNode[l], sink, maxCapacity);
+	});
+	return flow.solve(source, sink) == demand;
+}
+
+float GreedyModel::roomAt(const uint32_t l, const bool primary, const float sqDist, uint32_t& type) const
+{
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	const float primarySqDist = primary ? std::max(mServedSqDist[2 * l], sqDist) : mServedSqDist[2 * l];
+	const float secondarySqDist = primary ? mServedSqDist[2 * l + 1] : std::max(mServedSqDist[2 * l + 1], sqDist);
+	type = NOT_ASSIGNED;
+	for (uint32_t t = 0; t < mNumTypes; ++t) {
+		if (primarySqDist > mInstance->getSquaredServeDist(t, 0) || secondarySqDist > mInstance->getSquaredServeDist(t, 1)) {
+			continue;
 		}
-		if (worstFits[i] < worstFit) {
-			worstFit = worstFits[i];
+		// the current type on ties, so that it only changes to gain room
+		if (type == NOT_ASSIGNED || types[t].maxPop > types[type].maxPop || (types[t].maxPop == types[type].maxPop && t == mLocationTypeAssignment[l])) {
+			type = t;
 		}
 	}
-	if (bestFit == -std::numeric_limits<float>::infinity()) {
-		Candidate infeasible;
-		infeasible.fit = bestFit;
-		return infeasible;
+	if (type == NOT_ASSIGNED) {
+		return -1.0f;
 	}
-	float cutoff = bestFit-((bestFit-worstFit) * alpha);
-	uint32_t iter = 0;
-	for (uint32_t i = 0; i < candidates.size(); ++i) {
-		if (candidates[i].fit >= cutoff) {
-			RCL[iter] = candidates[i];
-			iter++;
+	return types[type].maxPop * 10.0f - mCenterServing[l];
+}
+
+bool GreedyModel::findRoomChain(const uint32_t c, const bool primary, const uint32_t depth, std::vector<uint32_t>& visited,
+	std::vector<ChainMove>& chain, float& cost, uint32_t& budget) const
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const float demand = static_cast<float>(cities[c].population) * (primary ? 10.0f : 1.0f);
+	const uint32_t other = primary ? mCityCenterAssignment[c].second : mCityCenterAssignment[c].first;
+	const vec2 position = cities[c].cityPos;
+
+	bool found = false;
+	std::vector<ChainMove>& rest = mRepairScratch.chains[depth - 1];
+	const uint32_t* reaching = getLocationsInReach(c);
+	const uint32_t numReaching = getNumLocationsInReach(c);
+	for (uint32_t li = 0; li < numReaching && budget != 0; ++li) {
+		const uint32_t l = reaching[li];
+		if (l == other || !isLocationOpen(l) || std::find(visited.begin(), visited.end(), l) != visited.end()) {
+			continue;
+		}
+		--budget;
+		const float sqDist = mBaseModel.getLocations()[l].sqDist(position);
+		uint32_t type;
+		const float room = roomAt(l, primary, sqDist, type);
+		if (type == NOT_ASSIGNED) {
+			continue;
+		}
+		const float distance = std::sqrt(sqDist);
+		if (demand <= room) {
+			if (!found || distance < cost) {
+				chain.assign(1, { c, primary, l, type });
+				cost = distance;
+				found = true;
+			}
+			continue;
+		}
+		if (depth <= 1) {
+			continue;
 		}
+
+		// one of the roles of l moves away, and must free enough
+		visited.push_back(l);
+		forEachServedCity(l, [&](const uint32_t x, const bool xPrimary) {
+			const float xDemand = static_cast<float>(cities[x].population) * (xPrimary ? 10.0f : 1.0f);
+			if (x == c || demand > room + xDemand || budget == 0) {
+				return;
+			}
+			float restCost;
+			if (!findRoomChain(x, xPrimary, depth - 1, visited, rest, restCost, budget)) {
+				return;
+			}
+			const float total = distance + restCost - std::sqrt(mBaseModel.getLocations()[l].sqDist(cities[x].cityPos));
+			if (!found || total < cost) {
+				chain.assign(1, { c, primary, l, type });
+				chain.insert(chain.end(), rest.begin(), rest.end());
+				cost = total;
+				found = true;
+			}
+		});
+		visited.pop_back();
+	}
+	return found;
+}
+
+// Drops the invalid assignments and the farthest cities of the overloaded centers,
+// then gives every role without a center the shortest chain of at most 3 moves, each
+// move making room for the previous one. The centers it changed end with the cheapest
+// type that fits. If some role is still missing, a max flow from the roles to the open
+// centers, with the population of a role free to split, proves when no assignment exists.
+// Past the deadline the roles left stay missing and the repair is partial
+GreedyModel::RepairResult GreedyModel::repairAssignment()
+{
+	const ArrayView<City> cities = mBaseModel.getCities();
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	auto demand = [&](const uint32_t c, const bool primary) {
+		return static_cast<float>(cities[c].population) * (primary ? 10.0f : 1.0f);
+	};
+
+	// assignments to closed or out of range centers, and twice the same center
+	bool missingRoles = false;
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		std::pair<uint32_t, uint32_t>& assigned = mCityCenterAssignment[c];
+		for (uint32_t isSecondary = 0; isSecondary < 2; ++isSecondary) {
+			uint32_t& l = isSecondary ? assigned.second : assigned.first;
+			if (l != NOT_ASSIGNED && (!isLocationOpen(l) || !isCityLocationTypeCompatible(c, l, mLocationTypeAssignment[l], isSecondary) ||
+				(isSecondary && l == assigned.first))) {
+				l = NOT_ASSIGNED;
+			}
+			missingRoles = missingRoles || l == NOT_ASSIGNED;
+		}
+	}
+	resetLoads();
+	bool overloaded = false;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		overloaded = overloaded || mCenterServing[l] > types[mLocationTypeAssignment[l]].maxPop * 10.0f;
+	});
+	if (!missingRoles && !overloaded) {
+		return RepairResult::Complete;
+	}
+
+	mServedSqDist.assign(2 * static_cast<size_t>(mNumLocations), 0.0f);
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		updateServedSqDist(l);
+	});
+	std::vector<uint32_t>& changed = mRepairScratch.changed;
+	changed.clear();
+
+	// an overloaded center takes the type of largest capacity, then its farthest
+	// cities leave until it fits
+	std::vector<std::pair<float, Reassignment>>& served = mRepairScratch.served;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		if (mCenterServing[l] <= types[mLocationTypeAssignment[l]].maxPop * 10.0f) {
+			return;
+		}
+		changed.push_back(l);
+		uint32_t type;
+		roomAt(l, true, 0.0f, type);
+		if (type != NOT_ASSIGNED && type != mLocationTypeAssignment[l]) {
+			setLocationType(l, type);
+		}
+		const float capacity = types[mLocationTypeAssignment[l]].maxPop * 10.0f;
+		served.clear();
+		forEachServedCity(l, [&](const uint32_t c, const bool primary) {
+			served.push_back({ mBaseModel.getLocations()[l].sqDist(cities[c].cityPos), { c, primary, l } });
+		});
+		std::sort(served.begin(), served.end(), [](const std::pair<float, Reassignment>& a, const std::pair<float, Reassignment>& b) {
+			return a.first > b.first || (a.first == b.first && (a.second.city < b.second.city || (a.second.city == b.second.city && a.second.primary > b.second.primary)));
+		});
+		for (size_t i = 0; i < served.size() && mCenterServing[l] > capacity; ++i) {
+			const Reassignment& r = served[i].second;
+			(r.primary ? mCityCenterAssignment[r.city].first : mCityCenterAssignment[r.city].second) = NOT_ASSIGNED;
+			mCenterServing[l] -= demand(r.city, r.primary);
+		}
+		updateExpLoad(l);
+		updateServedSqDist(l);
+	});
+
+	// the largest demands first, as in bin packing
+	std::vector<Reassignment>& missing = mRepairScratch.missing;
+	missing.clear();
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		if (mCityCenterAssignment[c].first == NOT_ASSIGNED) {
+			missing.push_back({ c, true, NOT_ASSIGNED });
+		}
+		if (mCityCenterAssignment[c].second == NOT_ASSIGNED) {
+			missing.push_back({ c, false, NOT_ASSIGNED });
+		}
+	}
+	std::sort(missing.begin(), missing.end(), [&](const Reassignment& a, const Reassignment& b) {
+		const float demandA = demand(a.city, a.primary);
+		const float demandB = demand(b.city, b.primary);
+		return demandA > demandB || (demandA == demandB && (a.city < b.city || (a.city == b.city && a.primary > b.primary)));
+	});
+	bool complete = true;
+	bool timedOut = false;
+	std::vector<uint32_t>& visited = mRepairScratch.visited;
+	mRepairScratch.chains.resize(MAX_CHAIN_DEPTH);
+	std::vector<ChainMove>& chain = mRepairScratch.chains[0];
+	for (const Reassignment& role : missing) {
+		// the roles left may still have a chain, so the repair is partial
+		if (std::chrono::steady_clock::now() >= mDeadline) {
+			complete = false;
+			timedOut = true;
+			break;
+		}
+		// the shortest chains first, a longer one only if none is found
+		bool found = false;
+		for (uint32_t depth = 1; depth <= MAX_CHAIN_DEPTH && !found; ++depth) {
+			uint32_t budget = CHAIN_BUDGET;
+			float cost;
+			visited.clear();
+			found = findRoomChain(role.city, role.primary, depth, visited, chain, cost, budget);
+		}
+		if (!found) {
+			complete = false;
+			continue;
+		}
+		// each move leaves the center the previous one entered
+		uint32_t left = NOT_ASSIGNED;
+		for (const ChainMove& move : chain) {
+			const float moved = demand(move.city, move.primary);
+			if (left != NOT_ASSIGNED) {
+				mCenterServing[left] -= moved;
+			}
+			if (mLocationTypeAssignment[move.location] != move.type) {
+				setLocationType(move.location, move.type);
+			}
+			(move.primary ? mCityCenterAssignment[move.city].first : mCityCenterAssignment[move.city].second) = move.location;
+			mCenterServing[move.location] += moved;
+			left = move.location;
+		}
+		for (const ChainMove& move : chain) {
+			updateExpLoad(move.location);
+			updateServedSqDist(move.location);
+			changed.push_back(move.location);
+		}
+	}
+
+	// the changed centers may now fit a cheaper type
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	for (const uint32_t l : changed) {
+		const uint32_t t = cheapestType(mCenterServing[l], mServedSqDist[2 * l], mServedSqDist[2 * l + 1], std::numeric_limits<float>::infinity());
+		if (t != NOT_ASSIGNED && t != mLocationTypeAssignment[l]) {
+			setLocationType(l, t);
+		}
+		updateExpLoad(l);
+	}
+
+	AMM_COUNT(AssignmentRepairs, 1);
+	if (complete) {
+		return RepairResult::Complete;
+	}
+	// the chains only change types, and the bound does not depend on them
+	if (timedOut || canServeAllRoles()) {
+		AMM_COUNT(PartialRepairs, 1);
+		return RepairResult::Partial;
 	}
-	uint32_t randElec = rand() % (iter);
-	return std::move(RCL[randElec]);
+	AMM_COUNT(InfeasibleRepairs, 1);
+	return RepairResult::Infeasible;
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <numeric>
 #include <iostream>
+#include <random>
+#include <chrono>
 
 #include "IModel.h"
 
@@ -12,19 +15,76 @@ public:
 
 	GreedyModel(const Model& model);
 
+	// Attaches to an instance shared with other models
+	GreedyModel(const std::shared_ptr<const ProblemInstance>& instance);
+
+	enum class RepairResult
+	{
+		// every city has two different centers in range and no center is overloaded
+		Complete,
+		// some roles still lack a center, an assignment may exist that the search missed
+		Partial,
+		// some roles lack a center and these centers cannot serve every city with any
+		// types, even letting the population of a city split among several of them
+		Infeasible
+	};
+
 	void runGreedy();
+
+	// Swap search, then repairAssignment, then trims the centers unless the repair
+	// proved that no assignment exists
 	void runParallelLocalSearch();
-	void GRASPConstructivePhase(float alpha);
+
+	// Lowers the cost of the centers, expects compatible assignments as left by the local search
+	void runNeighbourhoodDescent();
+
+	// Path relinking towards guide, leaves the best feasible solution on the path, false if there is none
+	bool runPathRelinking(const Solution& guide);
+
+	// Reassigns the cities to the open centers, whose types may change
+	RepairResult repairAssignment();
+
+	// Of the repair of the last local search
+	RepairResult getLastRepair() const { return mLastRepair; }
+
+	// False if the deadline passed before it finished, leaving a partial assignment
+	bool GRASPConstructivePhase(float alpha);
 	void purge();
 
+	// Replaces the current assignment and recomputes the loads and candidates from it
+	void setSolution(const Solution& solution);
+
+	// When enabled (default) only the candidates affected by the last action
+	// are re-evaluated on each constructive step, otherwise all of them are
+	void setIncrementalEvaluation(bool enabled);
+
+	// Threads used by the parallel kernels, all the hardware threads by default
+	void setNumThreads(int numThreads);
+
+	// Seeds the generator of the random choices of the GRASP constructive phase
+	void setSeed(uint32_t seed);
+
+	// The local search stops after maxSwaps swaps, or after maxNonImproving swaps in a
+	// row whose fit is not better than the previous one (10000 and 5 by default)
+	void setLocalSearchLimits(uint32_t maxSwaps, uint32_t maxNonImproving);
+
+	// The neighbourhood descent stops after maxMoves moves (10000 by default)
+	void setDescentLimit(uint32_t maxMoves);
+
+	// No step of runGreedy or of the constructive phase, no swap of the local search and
+	// no chain of the repair starts after the deadline, the result is still a valid
+	// assignment that may leave cities unassigned. No deadline by default
+	void setDeadline(std::chrono::steady_clock::time_point deadline);
+
 protected:
 
 	typedef struct Candidate
 	{
 		float fit;
-		std::vector<char> assigns;
 		uint32_t type;
 		uint32_t loc;
+		// the cities before this position of getCitiesSorted(loc) are assigned when applied
+		uint32_t cutoff;
 
 	} Candidate;
 
@@ -39,17 +99,128 @@ protected:
 
 	} Swap;
 
-	
-	// array of num cities * num locations, 
-	std::vector<uint32_t> mSortedCities;
+	enum class MoveKind
+	{
+		TypeChange,
+		Close,
+		Relocate,
+		Count
+	};
+
+	typedef struct Move
+	{
+		// change of the cost, negative if the move improves
+		float delta;
+		MoveKind kind;
+		uint32_t center;
+		// new location of a relocated center
+		uint32_t location;
+		// new type of a changed or relocated center
+		uint32_t type;
+
+	} Move;
+
+	// a city served by center as primary or secondary, and where it goes
+	typedef struct Reassignment
+	{
+		uint32_t city;
+		bool primary;
+		uint32_t location;
 
-	Candidate tryAddGreedy(const uint32_t l, const uint32_t t, std::vector<char>& assignments) const;
+	} Reassignment;
 
-	const uint32_t* getCitiesSorted(const uint32_t l) const;
+	// one move of a chain of repairAssignment, the location takes the type
+	typedef struct ChainMove
+	{
+		uint32_t city;
+		bool primary;
+		uint32_t location;
+		uint32_t type;
+
+	} ChainMove;
+
+	// a center receiving cities in planClose, as it would be after the previous ones
+	typedef struct Receiver
+	{
+		uint32_t location;
+		uint32_t type;
+		float load;
+		float sqDist[2];
+
+	} Receiver;
+
+	// buffers of the move evaluations, reused so that the descent does not allocate
+	typedef struct MoveScratch
+	{
+		std::vector<Reassignment> plan;
+		std::vector<std::pair<uint32_t, uint32_t>> upgrades;
+		std::vector<Receiver> receivers;
+		std::vector<std::pair<uint32_t, bool>> served;
 
+	} MoveScratch;
+
+	// buffers of repairAssignment, reused so that a repair does not allocate. chains[0]
+	// holds the chain of a role, chains[d - 1] the rest of a chain searched at depth d
+	typedef struct RepairScratch
+	{
+		std::vector<uint32_t> changed;
+		std::vector<std::pair<float, Reassignment>> served;
+		std::vector<Reassignment> missing;
+		std::vector<uint32_t> visited;
+		std::vector<std::vector<ChainMove>> chains;
+
+	} RepairScratch;
+
+	// every candidate, indexed as l * mNumTypes + t
+	std::vector<Candidate> mCandidates;
+
+	// locations whose candidates are outdated in mCandidates
+	std::vector<uint32_t> mDirtyLocations;
+	std::vector<char> mLocationIsDirty;
+
+	bool mIncrementalEvaluation = true;
+
+	int mNumThreads;
+
+	std::mt19937 mRng;
+
+	uint32_t mMaxSwaps = 10000;
+	uint32_t mMaxNonImproving = 5;
+	uint32_t mMaxMoves = 10000;
+	std::chrono::steady_clock::time_point mDeadline = std::chrono::steady_clock::time_point::max();
+
+	// population served by each location, primary assignments count 10 times
+	std::vector<float> mCenterServing;
+
+	// exp of the load of each center, 0 if it serves nobody, and their sum
+	std::vector<double> mCenterExpLoad;
+	double mUsefulLoad = 0.0;
+
+	// squared distance to the farthest city each location serves, as primary at
+	// 2 * l and as secondary at 2 * l + 1. Only kept during the descent
+	std::vector<float> mServedSqDist;
+
+	// one per thread of the descent, indexed by the OpenMP thread number
+	mutable std::vector<MoveScratch> mMoveScratch;
+
+	mutable RepairScratch mRepairScratch;
+
+	RepairResult mLastRepair = RepairResult::Complete;
+
+	Candidate tryAddGreedy(const uint32_t l, const uint32_t t) const;
+
+	// Index in mCandidates of the i-th candidate of the available locations
+	uint32_t availableCandidate(const uint32_t i) const { return mAvailableLocations[i / mNumTypes] * mNumTypes + i % mNumTypes; }
+
+	void markLocationDirty(const uint32_t l);
+
+	void markAllLocationsDirty();
+
+	// Re-evaluates the candidates of the dirty locations
+	void refreshCandidates();
 
 	// Returns location and type
-	Candidate findBestAddition(std::vector<Candidate> &bestCandidates, uint32_t perThread, int processor_count) const;
+	Candidate findBestAddition();
 
 	void applyAction(const Candidate& bestAction);
 
@@ -57,11 +228,90 @@ protected:
 
 	void trimLocations();
 
-	Swap findBestSwap(std::vector<Swap> bestSwaps, uint32_t perThread, int processor_count);
+	Swap findBestSwap() const;
+
+	// Recomputes the exp load of l after its serving or type changed
+	void updateExpLoad(const uint32_t l);
+
+	// Recomputes mCenterServing and the exp loads from the assignments
+	void resetLoads();
+
+	Candidate findCandidateGRASP(std::vector<uint32_t> &RCL, float alpha);
+
+	// Cities served by l, with primary set for the primary ones
+	template<typename F>
+	void forEachServedCity(const uint32_t l, F f) const;
+
+	void updateServedSqDist(const uint32_t l);
+
+	// Cheapest type that serves load with the given farthest cities at l, or
+	// NOT_ASSIGNED if none costs less than maxCost
+	uint32_t cheapestType(const float load, const float primarySqDist, const float secondarySqDist, const float maxCost) const;
+
+	// Buffers of the calling thread, the serial code gets the first ones
+	MoveScratch& getMoveScratch() const;
+
+	// The move of kind for center on the current state, delta is 0 if there is none
+	Move evaluateMove(const MoveKind kind, const uint32_t center) const;
 
-	double getUsefulLoad(std::vector<float> centerServing);
+	// One move per open center, the improving ones best first
+	std::vector<Move> findImprovingMoves(MoveKind kind) const;
 
-	Candidate findCandidateGRASP(std::vector<Candidate> &candidates, std::vector<Candidate> &RCL,std::vector<std::vector<char>> &assignments, uint32_t perThread, int processor_count, float alpha) const;
+	// Cities of center and other centers for them, false if some city has none.
+	// delta is the cost of the upgrades minus the cost of center
+	bool planClose(const uint32_t center, std::vector<Reassignment>& plan, std::vector<std::pair<uint32_t, uint32_t>>& upgrades, float& delta) const;
+
+	// Cheapest relocation of center to a free location, delta is 0 if there is none
+	Move planRelocation(const uint32_t center) const;
+
+	void applyMove(const Move& move);
+
+	// Unassigns the cities served by l, appending them to released
+	void releaseCenter(const uint32_t l, std::vector<uint32_t>& released);
+
+	// Gives l its type in guide, see runPathRelinking
+	void moveToGuide(const uint32_t l, const Solution& guide, std::vector<uint32_t>& released);
+
+	// Assigns the missing centers of the released cities, see runPathRelinking
+	void reassignReleased(const std::vector<uint32_t>& released, const Solution& guide);
+
+	// Whether the open centers could serve every role with the largest capacity and
+	// range of any type, if the population of a role could split among them. Every
+	// city, with or without population, also needs one open center in primary range
+	// and another one in secondary range
+	bool canServeAllRoles() const;
+
+	// Room at l for a role at sqDist from it, with the type of largest capacity that
+	// keeps the cities of l in range, returned in type. Negative if none does.
+	// Reads mServedSqDist
+	float roomAt(const uint32_t l, const bool primary, const float sqDist, uint32_t& type) const;
+
+	// Shortest chain of at most depth moves that gives the role a center: the role
+	// goes to a center in range that either has room, or makes it by moving one of
+	// its roles by a shorter chain. Centers in visited are not used, and every center
+	// tried spends one unit of budget. cost is the change of the summed distances
+	bool findRoomChain(const uint32_t c, const bool primary, const uint32_t depth, std::vector<uint32_t>& visited,
+		std::vector<ChainMove>& chain, float& cost, uint32_t& budget) const;
 
 };
 
+template<typename F>
+void GreedyModel::forEachServedCity(const uint32_t l, F f) const
+{
+	// the secondary range of a type contains its primary range, the widest one
+	// also has the cities served through an incompatible assignment
+	const uint32_t* cities = getCitiesSorted(l);
+	uint32_t numCities = 0;
+	for (uint32_t t = 0; t < mNumTypes; ++t) {
+		numCities = std::max(numCities, getNumCitiesInRange(l, t, 1));
+	}
+	for (uint32_t i = 0; i < numCities; ++i) {
+		const uint32_t c = cities[i];
+		if (mCityCenterAssignment[c].first == l) {
+			f(c, true);
+		}
+		if (mCityCenterAssignment[c].second == l) {
+			f(c, false);
+		}
+	}
+}
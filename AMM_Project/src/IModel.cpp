@@ -1,50 +1,43 @@
 #include "IModel.h"
 
-#include <map>
 #include <iostream>
+#include <algorithm>
+#include <numeric>
 #include <smmintrin.h>
 IModel::IModel(const Model& model) :
-	mBaseModel(model),
-	mNumLocations(static_cast<uint32_t>(model.getLocations().size())),
-	mNumTypes(static_cast<uint32_t>(model.getCenterTypes().size())),
-	mNumCities(static_cast<uint32_t>(model.getCities().size()))
+	IModel(std::make_shared<const ProblemInstance>(model))
 {
-	mCompatibleLocations.resize(mNumLocations * mNumLocations);
-	// compute location compatibility
-	for (uint32_t l1 = 0; l1 < mNumLocations; ++l1) {
-		mCompatibleLocations[(l1 * mNumLocations +l1)] = true;
-		for (uint32_t l2 = l1+1; l2 < mNumLocations; ++l2) {
-			bool res = model.getLocations()[l1].dist(model.getLocations()[l2]) >= model.getMinDistanceBetweenCenters();
-			mCompatibleLocations[(l1 * mNumLocations + l2)] = res;
-			mCompatibleLocations[(l2 * mNumLocations + l1)] = res;
-		}
-	}
 
-	// compute city can be assigned to center in location of type
-	mCompatibleCityLocationType.resize(2 * mNumCities * mNumLocations * mNumTypes);
-	for (uint32_t c = 0; c < mNumCities; ++c) {
-		for (uint32_t l = 0; l < mNumLocations; ++l) {
-			for (uint32_t t = 0; t < mNumTypes; ++t) {
-				uint32_t idx = (((c * mNumLocations + l) * mNumTypes + t) * 2);
-				mCompatibleCityLocationType[idx] = 
-					model.getCities()[c].cityPos.dist(model.getLocations()[l]) <= 
-					model.getCenterTypes()[t].serveDist;
-				mCompatibleCityLocationType[idx + 1] = 
-					model.getCities()[c].cityPos.dist(model.getLocations()[l]) <= 
-					3 * model.getCenterTypes()[t].serveDist;
-			}
-		}
-	}
+}
+
+IModel::IModel(const std::shared_ptr<const ProblemInstance>& instance) :
+	mInstance(instance),
+	mBaseModel(instance->getModel()),
+	mNumLocations(instance->getNumLocations()),
+	mNumTypes(instance->getNumTypes()),
+	mNumCities(instance->getNumCities()),
+	mLocationWords(instance->getLocationWords())
+{
+	mOpenCenters.resize(mLocationWords, 0);
+	mBlockedCount.resize(mNumLocations, 0);
+	mAvailableLocations.resize(mNumLocations);
+	mAvailablePos.resize(mNumLocations);
+	std::iota(mAvailableLocations.begin(), mAvailableLocations.end(), 0);
+	std::iota(mAvailablePos.begin(), mAvailablePos.end(), 0);
 }
 
 
 IModel::IModel(const IModel* model) : 
+	mInstance(model->mInstance),
 	mBaseModel(model->mBaseModel),
-	mCompatibleCityLocationType(model->mCompatibleCityLocationType),
-	mCompatibleLocations(model->mCompatibleLocations),
 	mNumLocations(model->mNumLocations),
 	mNumTypes(model->mNumTypes),
 	mNumCities(model->mNumCities),
+	mLocationWords(model->mLocationWords),
+	mOpenCenters(model->mOpenCenters),
+	mBlockedCount(model->mBlockedCount),
+	mAvailableLocations(model->mAvailableLocations),
+	mAvailablePos(model->mAvailablePos),
 	mLocationTypeAssignment(model->mLocationTypeAssignment),
 	mCityCenterAssignment(model->mCityCenterAssignment)
 {
@@ -110,64 +103,140 @@ bool IModel::isSolution() const
 
 
 
-bool IModel::isLocationPairCompatible(const uint32_t& l1, const uint32_t& l2) const
+Solution IModel::getSolution() const
 {
-	return mCompatibleLocations[(l1 * mNumLocations + l2)];
+	Solution solution;
+	solution.locationTypes = mLocationTypeAssignment;
+	solution.cityCenters = mCityCenterAssignment;
+	solution.cost = getCentersCost();
+	return solution;
 }
 
-bool IModel::areAllLocationsCompatible() const
+void IModel::setSolution(const Solution& solution)
 {
-	for (uint32_t l1 = 0; l1 < mNumLocations; ++l1) {
-		for (uint32_t l2 = l1 + 1; l2 < mNumLocations; ++l2) {
-			if (mLocationTypeAssignment[l1] != NOT_ASSIGNED &&
-				mLocationTypeAssignment[l2] != NOT_ASSIGNED &&
-				!isLocationPairCompatible(l1, l2)) {
-				return false;
-			}
-		}
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		setLocationType(l, solution.locationTypes[l]);
 	}
-
-	return true;
+	mCityCenterAssignment = solution.cityCenters;
 }
 
+void IModel::setLocationType(const uint32_t l, const uint32_t t)
+{
+	const bool wasOpen = isLocationOpen(l);
+	const bool open = t != NOT_ASSIGNED;
+	mLocationTypeAssignment[l] = t;
+	if (wasOpen == open) {
+		return;
+	}
+
+	if (open) {
+		mOpenCenters[l / 64] |= uint64_t(1) << (l % 64);
+	}
+	else {
+		mOpenCenters[l / 64] &= ~(uint64_t(1) << (l % 64));
+	}
+	updateAvailability(l);
+	forEachConflictingLocation(l, [&](const uint32_t l2) {
+		if (open) {
+			mBlockedCount[l2]++;
+		}
+		else {
+			mBlockedCount[l2]--;
+		}
+		updateAvailability(l2);
+	});
+}
 
-bool IModel::isCityLocationTypeCompatible(
-	const uint32_t& c,
-	const uint32_t& l,
-	const uint32_t& t, 
-	const uint32_t& isSecondary) const
+void IModel::updateAvailability(const uint32_t l)
 {
-	return mCompatibleCityLocationType[(((c * mNumLocations + l) * mNumTypes + t) * 2 + isSecondary)];
+	const bool available = !isLocationOpen(l) && mBlockedCount[l] == 0;
+	if (available && mAvailablePos[l] == NOT_ASSIGNED) {
+		mAvailablePos[l] = static_cast<uint32_t>(mAvailableLocations.size());
+		mAvailableLocations.push_back(l);
+	}
+	else if (!available && mAvailablePos[l] != NOT_ASSIGNED) {
+		// move the last one to the hole
+		const uint32_t last = mAvailableLocations.back();
+		mAvailableLocations[mAvailablePos[l]] = last;
+		mAvailablePos[last] = mAvailablePos[l];
+		mAvailableLocations.pop_back();
+		mAvailablePos[l] = NOT_ASSIGNED;
+	}
 }
 
+bool IModel::areAllLocationsCompatible() const
+{
+	// an open center conflicts with another one if its blocked count is not zero
+	bool compatible = true;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		compatible = compatible && !locationIsBlocked(l);
+	});
+	return compatible;
+}
 
 
-bool IModel::locationIsBlocked(const uint32_t l) const
+SolutionReport IModel::getReport() const
 {
-	for (uint32_t l2 = 0; l2 < mNumLocations; ++l2) {
-		if (mLocationTypeAssignment[l2] != NOT_ASSIGNED && !isLocationPairCompatible(l, l2)) {
-			return true;
+	SolutionReport report;
+	report.cost = getCentersCost();
+
+	// in tenths of population to stay exact, as in isSolutionPop
+	std::vector<uint32_t> popSum(mNumLocations, 0);
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		const std::pair<uint32_t, uint32_t>& centers = mCityCenterAssignment[c];
+		if (centers.first == NOT_ASSIGNED || centers.second == NOT_ASSIGNED) {
+			report.unassignedCities++;
+		}
+		else if (centers.first == centers.second) {
+			report.sameCenterCities++;
+		}
+		const uint32_t population = mBaseModel.getCities()[c].population;
+		if (centers.first != NOT_ASSIGNED) {
+			popSum[centers.first] += 10 * population;
+			if (!isLocationOpen(centers.first) || !isCityLocationTypeCompatible(c, centers.first, mLocationTypeAssignment[centers.first], 0)) {
+				report.invalidAssignments++;
+			}
+		}
+		if (centers.second != NOT_ASSIGNED) {
+			popSum[centers.second] += population;
+			if (!isLocationOpen(centers.second) || !isCityLocationTypeCompatible(c, centers.second, mLocationTypeAssignment[centers.second], 1)) {
+				report.invalidAssignments++;
+			}
 		}
 	}
-	return false;
+
+	report.centerLoads.resize(mNumLocations);
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		report.centerLoads[l] = 0.1f * static_cast<float>(popSum[l]);
+		if (isLocationOpen(l)) {
+			if (popSum[l] > 10 * mBaseModel.getCenterTypes()[mLocationTypeAssignment[l]].maxPop) {
+				report.overloadedCenters++;
+			}
+			if (locationIsBlocked(l)) {
+				report.conflictingCenters++;
+			}
+		}
+	}
+
+	report.feasible = report.unassignedCities == 0 && report.sameCenterCities == 0 && report.invalidAssignments == 0 &&
+		report.overloadedCenters == 0 && report.conflictingCenters == 0;
+	return report;
 }
+
 std::ostream& operator<<(std::ostream& os, const IModel& dt)
 {
-	std::map<uint32_t, float> centerServing;
-	for (uint32_t i = 0; i < dt.mNumLocations; ++i) {
-		centerServing.insert({ i, 0.0f });
-	}
+	std::vector<float> centerServing(dt.mNumLocations, 0.0f);
 
 	os << "\nCities assigned to:\n";
 	for (uint32_t i = 0; i < dt.mCityCenterAssignment.size(); ++i) {
 		os << "City " << i << " first: " << static_cast<int>(dt.mCityCenterAssignment[i].first != dt.NOT_ASSIGNED ? dt.mCityCenterAssignment[i].first : -1)
 			<< " second: " << static_cast<int>(dt.mCityCenterAssignment[i].second != dt.NOT_ASSIGNED ? dt.mCityCenterAssignment[i].second : -1) << "\n";
 
-		if (centerServing.count(dt.mCityCenterAssignment[i].first)) {
-			centerServing.at(dt.mCityCenterAssignment[i].first) += dt.mBaseModel.getCities()[i].population;
+		if (dt.mCityCenterAssignment[i].first != dt.NOT_ASSIGNED) {
+			centerServing[dt.mCityCenterAssignment[i].first] += dt.mBaseModel.getCities()[i].population;
 		}
-		if (centerServing.count(dt.mCityCenterAssignment[i].second)) {
-			centerServing.at(dt.mCityCenterAssignment[i].second) += 0.1f * dt.mBaseModel.getCities()[i].population;
+		if (dt.mCityCenterAssignment[i].second != dt.NOT_ASSIGNED) {
+			centerServing[dt.mCityCenterAssignment[i].second] += 0.1f * dt.mBaseModel.getCities()[i].population;
 		}
 
 	}
@@ -176,9 +245,9 @@ std::ostream& operator<<(std::ostream& os, const IModel& dt)
 	for (uint32_t i = 0; i < dt.mLocationTypeAssignment.size(); ++i) {
 		if (dt.mLocationTypeAssignment[i] != dt.NOT_ASSIGNED) {
 			os << "Location " << i << " assigned with center type " << dt.mLocationTypeAssignment[i] << "\n";
-			os << "\tServing to " << centerServing.at(i) << "/" << dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[i]].maxPop << " population\n";
+			os << "\tServing to " << centerServing[i] << "/" << dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[i]].maxPop << " population\n";
 
-			if (centerServing.at(i) > dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[i]].maxPop + 1e-4) {
+			if (centerServing[i] > dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[i]].maxPop + 1e-4) {
 				badLocations.push_back(i);
 			}
 		}
@@ -206,7 +275,7 @@ std::ostream& operator<<(std::ostream& os, const IModel& dt)
 	}
 
 	for (uint32_t l : badLocations) {
-		os << "Bad location " << l << " with " << centerServing.at(l) << "/" << dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[l]].maxPop << " population\n";
+		os << "Bad location " << l << " with " << centerServing[l] << "/" << dt.mBaseModel.getCenterTypes()[dt.mLocationTypeAssignment[l]].maxPop << " population\n";
 	}
 
 	return os;
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "Model.h"
+#include "ProblemInstance.h"
+#include "Solution.h"
 #include <vector>
+#include <memory>
 
 class IModel
 {
 public:
+	// Builds its own ProblemInstance
 	IModel(const Model& model);
+	IModel(const std::shared_ptr<const ProblemInstance>& instance);
 	IModel(const IModel* model);
 
 	float getCentersCost() const;
@@ -19,13 +24,24 @@ public:
 
 	bool isSolution() const;
 
+	// Copy of the current assignment, O(C + L)
+	Solution getSolution() const;
+
+	// Replaces the current assignment
+	void setSolution(const Solution& solution);
+
+	// Loads of the centers and every constraint violation, O(C + L)
+	SolutionReport getReport() const;
+
+	const std::shared_ptr<const ProblemInstance>& getInstance() const { return mInstance; }
 
 protected:
 
-	Model mBaseModel;
+	// Precomputed data of the instance, shared read only with every other model
+	// attached to it
+	std::shared_ptr<const ProblemInstance> mInstance;
 
-	std::vector<bool> mCompatibleLocations;
-	std::vector<bool> mCompatibleCityLocationType;
+	const Model& mBaseModel;
 
 	const uint32_t mNumLocations;
 	const uint32_t mNumTypes;
@@ -33,22 +49,66 @@ protected:
 
 	static constexpr uint32_t NOT_ASSIGNED = std::numeric_limits<uint32_t>::max();
 
+	// words of mOpenCenters
+	const uint32_t mLocationWords;
+
+	// Bit l is set if mLocationTypeAssignment[l] != NOT_ASSIGNED
+	AlignedVector<uint64_t> mOpenCenters;
+
+	// Number of open centers that conflict with each location
+	std::vector<uint32_t> mBlockedCount;
+
+	// Locations without a center that are not blocked, in no particular order,
+	// mAvailablePos[l] is the position of l in it or NOT_ASSIGNED
+	std::vector<uint32_t> mAvailableLocations;
+	std::vector<uint32_t> mAvailablePos;
+
 	std::vector<uint32_t> mLocationTypeAssignment;
 
 	std::vector<std::pair<uint32_t, uint32_t>> mCityCenterAssignment;
 
-	bool isLocationPairCompatible(const uint32_t& l1, const uint32_t& l2) const;
+	// Every write to mLocationTypeAssignment goes through here to keep mOpenCenters,
+	// the blocked counts and the available locations in sync
+	void setLocationType(const uint32_t l, const uint32_t t);
+
+	bool isLocationOpen(const uint32_t l) const { return (mOpenCenters[l / 64] >> (l % 64) & 1) != 0; }
+
+	bool isLocationPairCompatible(const uint32_t& l1, const uint32_t& l2) const { return mInstance->isLocationPairCompatible(l1, l2); }
 
 	bool areAllLocationsCompatible() const;
 
-	bool locationIsBlocked(const uint32_t l) const;
+	bool locationIsBlocked(const uint32_t l) const { return mBlockedCount[l] != 0; }
+
+	// Adds l to or removes it from the available locations
+	void updateAvailability(const uint32_t l);
 
+	// Calls f(l2) for every location l2 that cannot have a center at the same time as l
+	template<typename F>
+	void forEachConflictingLocation(const uint32_t l, F f) const { mInstance->forEachConflictingLocation(l, f); }
 
 	// c < mNumCities, l < mNumLocations, t < mNumTypes, isSecondary {0,1}
-	bool isCityLocationTypeCompatible(const uint32_t& c, const uint32_t& l, const uint32_t& t, const uint32_t& isSecondary) const;
+	bool isCityLocationTypeCompatible(const uint32_t& c, const uint32_t& l, const uint32_t& t, const uint32_t& isSecondary) const
+	{
+		return mInstance->isCityLocationTypeCompatible(c, l, t, isSecondary);
+	}
+
+	// Reachable cities of l sorted by distance
+	const uint32_t* getCitiesSorted(const uint32_t l) const { return mInstance->getCitiesSorted(l); }
+
+	// The first getNumCitiesInRange(l, t, isSecondary) cities of getCitiesSorted(l)
+	// are the ones compatible with a center of type t at l
+	uint32_t getNumCitiesInRange(const uint32_t l, const uint32_t t, const uint32_t isSecondary) const
+	{
+		return mInstance->getNumCitiesInRange(l, t, isSecondary);
+	}
 
+	// Locations within reach of city c in increasing order, getNumLocationsInReach(c) of them
+	const uint32_t* getLocationsInReach(const uint32_t c) const { return mInstance->getLocationsInReach(c); }
+
+	uint32_t getNumLocationsInReach(const uint32_t c) const { return mInstance->getNumLocationsInReach(c); }
+
+	// Human readable dump of every assignment, slow on big instances
 	friend std::ostream& operator<<(std::ostream& os, const IModel& dt);
 
 	friend class LocalSearchModel;
 };
-
@@ -0,0 +1,263 @@
+#include "Instrumentation.h"
+
+#ifdef AMM_INSTRUMENTATION
+
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+	const size_t NUM_COUNTERS = static_cast<size_t>(Counter::Count);
+	const size_t NUM_TIMERS = static_cast<size_t>(Timer::Count);
+	// bucket b holds the iterations of [2^b, 2^(b+1)) nanoseconds
+	const size_t NUM_LATENCY_BUCKETS = 64;
+
+	const char* const COUNTER_NAMES[NUM_COUNTERS] = {
+		"tryAddGreedy calls",
+		"candidates evaluated",
+		"candidates blocked",
+		"swaps evaluated",
+		"swaps applied",
+		"assignment repairs",
+		"partial repairs",
+		"infeasible repairs",
+		"allocations",
+		"allocated bytes"
+	};
+
+	const char* const TIMER_NAMES[NUM_TIMERS] = {
+		"parallel regions",
+		"serial reductions"
+	};
+
+	typedef struct Totals
+	{
+		uint64_t counters[NUM_COUNTERS];
+		uint64_t timers[NUM_TIMERS];
+		uint64_t latency[NUM_LATENCY_BUCKETS];
+	} Totals;
+
+	// Only the owning thread writes its slots, the summary reads them from any thread.
+	// Trivially destructible, so that the retired totals outlive every thread
+	struct AtomicTotals
+	{
+		std::atomic<uint64_t> counters[NUM_COUNTERS];
+		std::atomic<uint64_t> timers[NUM_TIMERS];
+		std::atomic<uint64_t> latency[NUM_LATENCY_BUCKETS];
+
+		void addTo(Totals& totals) const
+		{
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				totals.counters[i] += counters[i].load(std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < NUM_TIMERS; ++i) {
+				totals.timers[i] += timers[i].load(std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+				totals.latency[i] += latency[i].load(std::memory_order_relaxed);
+			}
+		}
+
+		void addTo(AtomicTotals& totals) const
+		{
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				totals.counters[i].fetch_add(counters[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < NUM_TIMERS; ++i) {
+				totals.timers[i].fetch_add(timers[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+				totals.latency[i].fetch_add(latency[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+		}
+
+		void reset()
+		{
+			for (std::atomic<uint64_t>& counter : counters) {
+				counter.store(0, std::memory_order_relaxed);
+			}
+			for (std::atomic<uint64_t>& timer : timers) {
+				timer.store(0, std::memory_order_relaxed);
+			}
+			for (std::atomic<uint64_t>& bucket : latency) {
+				bucket.store(0, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	struct ThreadSlots;
+
+	// Constant initialized, so that allocations made before main can be counted
+	std::mutex gRegistryMutex;
+	ThreadSlots* gThreads = nullptr;
+	AtomicTotals gRetired = {};
+
+	// Trivially destructible, set when the slots of the thread are destroyed. What the
+	// thread counts after that, in other thread_local or static destructors, goes to gRetired
+	thread_local bool tSlotsDestroyed = false;
+
+	struct ThreadSlots : AtomicTotals
+	{
+		ThreadSlots* prev;
+		ThreadSlots* next;
+
+		ThreadSlots() : prev(nullptr), next(nullptr)
+		{
+			reset();
+			std::lock_guard<std::mutex> lock(gRegistryMutex);
+			next = gThreads;
+			if (gThreads != nullptr) {
+				gThreads->prev = this;
+			}
+			gThreads = this;
+		}
+
+		// what the thread counted is kept for the summary
+		~ThreadSlots()
+		{
+			std::lock_guard<std::mutex> lock(gRegistryMutex);
+			tSlotsDestroyed = true;
+			addTo(gRetired);
+			if (prev != nullptr) {
+				prev->next = next;
+			}
+			else {
+				gThreads = next;
+			}
+			if (next != nullptr) {
+				next->prev = prev;
+			}
+		}
+	};
+
+	// null once the slots of the calling thread are destroyed
+	ThreadSlots* threadSlots()
+	{
+		if (tSlotsDestroyed) {
+			return nullptr;
+		}
+		thread_local ThreadSlots slots;
+		return &slots;
+	}
+
+	// a plain load and store, the slot has a single writer
+	void increase(std::atomic<uint64_t>& slot, uint64_t n)
+	{
+		slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	void printDuration(std::ostream& out, double nanoseconds)
+	{
+		if (nanoseconds >= 1e9) {
+			out << nanoseconds / 1e9 << " s";
+		}
+		else if (nanoseconds >= 1e6) {
+			out << nanoseconds / 1e6 << " ms";
+		}
+		else if (nanoseconds >= 1e3) {
+			out << nanoseconds / 1e3 << " us";
+		}
+		else {
+			out << nanoseconds << " ns";
+		}
+	}
+}
+
+void Instrumentation::count(Counter counter, uint64_t n)
+{
+	const size_t i = static_cast<size_t>(counter);
+	if (ThreadSlots* slots = threadSlots()) {
+		increase(slots->counters[i], n);
+	}
+	else {
+		gRetired.counters[i].fetch_add(n, std::memory_order_relaxed);
+	}
+}
+
+void Instrumentation::addTime(Timer timer, uint64_t nanoseconds)
+{
+	const size_t i = static_cast<size_t>(timer);
+	if (ThreadSlots* slots = threadSlots()) {
+		increase(slots->timers[i], nanoseconds);
+	}
+	else {
+		gRetired.timers[i].fetch_add(nanoseconds, std::memory_order_relaxed);
+	}
+}
+
+void Instrumentation::addIterationLatency(uint64_t nanoseconds)
+{
+	size_t bucket = 0;
+	while (bucket + 1 < NUM_LATENCY_BUCKETS && (nanoseconds >> (bucket + 1)) != 0) {
+		++bucket;
+	}
+	if (ThreadSlots* slots = threadSlots()) {
+		increase(slots->latency[bucket], 1);
+	}
+	else {
+		gRetired.latency[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void Instrumentation::dump(std::ostream& out)
+{
+	Totals totals = {};
+	{
+		std::lock_guard<std::mutex> lock(gRegistryMutex);
+		gRetired.addTo(totals);
+		for (const ThreadSlots* slots = gThreads; slots != nullptr; slots = slots->next) {
+			slots->addTo(totals);
+		}
+	}
+
+	out << "Instrumentation summary\n";
+	for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+		out << "  " << std::left << std::setw(22) << COUNTER_NAMES[i] << std::right << totals.counters[i] << "\n";
+	}
+	for (size_t i = 0; i < NUM_TIMERS; ++i) {
+		out << "  " << std::left << std::setw(22) << TIMER_NAMES[i] << std::right;
+		printDuration(out, static_cast<double>(totals.timers[i]));
+		out << "\n";
+	}
+
+	uint64_t iterations = 0;
+	for (const uint64_t bucketCount : totals.latency) {
+		iterations += bucketCount;
+	}
+	out << "  GRASP iterations      " << iterations << "\n";
+	for (size_t b = 0; b < NUM_LATENCY_BUCKETS; ++b) {
+		if (totals.latency[b] == 0) {
+			continue;
+		}
+		out << "    < ";
+		printDuration(out, std::ldexp(1.0, static_cast<int>(b) + 1));
+		out << ": " << totals.latency[b] << "\n";
+	}
+	out.flush();
+}
+
+void Instrumentation::reset()
+{
+	std::lock_guard<std::mutex> lock(gRegistryMutex);
+	gRetired.reset();
+	for (ThreadSlots* slots = gThreads; slots != nullptr; slots = slots->next) {
+		slots->reset();
+	}
+}
+
+#else
+
+void Instrumentation::count(Counter, uint64_t) {}
+void Instrumentation::addTime(Timer, uint64_t) {}
+void Instrumentation::addIterationLatency(uint64_t) {}
+
+void Instrumentation::dump(std::ostream& out)
+{
+	out << "Instrumentation disabled, build with AMM_INSTRUMENTATION defined to collect it" << std::endl;
+}
+
+void Instrumentation::reset() {}
+
+#endif
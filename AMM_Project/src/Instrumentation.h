@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Counters of the solver hot paths, compiled in only when AMM_INSTRUMENTATION is
+// defined. Every thread counts into its own slots, so counting never contends, and
+// the slots of the threads that already finished are kept until the summary.
+// Without the define the macros expand to nothing and the summary only says so.
+
+enum class Counter
+{
+	TryAddGreedy,
+	CandidatesEvaluated,
+	// the location already has a center or a neighbouring center blocks it
+	CandidatesBlocked,
+	SwapsEvaluated,
+	SwapsApplied,
+	// repairs with a role to assign or a center to unload, and the ones that left a
+	// role without a center, with or without an assignment possible
+	AssignmentRepairs,
+	PartialRepairs,
+	InfeasibleRepairs,
+	Allocations,
+	AllocatedBytes,
+	Count
+};
+
+enum class Timer
+{
+	// wall time of the OpenMP regions of parallelFor and parallelReduce
+	ParallelRegion,
+	// merge of the per thread partial results of parallelReduce
+	SerialReduction,
+	Count
+};
+
+class Instrumentation
+{
+public:
+
+	static constexpr bool isEnabled()
+	{
+#ifdef AMM_INSTRUMENTATION
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static void count(Counter counter, uint64_t n = 1);
+	static void addTime(Timer timer, uint64_t nanoseconds);
+
+	// one GRASP iteration, kept in a histogram with power of two buckets
+	static void addIterationLatency(uint64_t nanoseconds);
+
+	// totals of all the threads since the start or the last reset, reset only
+	// while no solver is running
+	static void dump(std::ostream& out);
+	static void reset();
+};
+
+// Adds the time from construction to destruction to a timer, or to the
+// iteration histogram
+class ScopedInstrumentationTimer
+{
+public:
+
+	explicit ScopedInstrumentationTimer(Timer timer) : mTimer(timer), mIteration(false), mStart(std::chrono::steady_clock::now()) {}
+	ScopedInstrumentationTimer() : mTimer(Timer::Count), mIteration(true), mStart(std::chrono::steady_clock::now()) {}
+
+	~ScopedInstrumentationTimer()
+	{
+		const uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count());
+		if (mIteration) {
+			Instrumentation::addIterationLatency(elapsed);
+		}
+		else {
+			Instrumentation::addTime(mTimer, elapsed);
+		}
+	}
+
+	ScopedInstrumentationTimer(const ScopedInstrumentationTimer&) = delete;
+	ScopedInstrumentationTimer& operator=(const ScopedInstrumentationTimer&) = delete;
+
+private:
+
+	Timer mTimer;
+	bool mIteration;
+	std::chrono::steady_clock::time_point mStart;
+};
+
+#define AMM_INSTRUMENTATION_CONCAT2(a, b) a##b
+#define AMM_INSTRUMENTATION_CONCAT(a, b) AMM_INSTRUMENTATION_CONCAT2(a, b)
+
+#ifdef AMM_INSTRUMENTATION
+#define AMM_COUNT(counter, n) Instrumentation::count(Counter::counter, (n))
+#define AMM_TIME_SCOPE(timer) ScopedInstrumentationTimer AMM_INSTRUMENTATION_CONCAT(ammTimer, __LINE__)(Timer::timer)
+#define AMM_ITERATION_SCOPE() ScopedInstrumentationTimer AMM_INSTRUMENTATION_CONCAT(ammIteration, __LINE__)
+#else
+#define AMM_COUNT(counter, n) ((void)0)
+#define AMM_TIME_SCOPE(timer) ((void)0)
+#define AMM_ITERATION_SCOPE() ((void)0)
+#endif
@@ -0,0 +1,112 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	mFile = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		close();
+		return false;
+	}
+	// an empty file cannot be mapped
+	if (size.QuadPart == 0) {
+		return true;
+	}
+	mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr) {
+		close();
+		return false;
+	}
+	mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr) {
+		close();
+		return false;
+	}
+	mSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData != nullptr) {
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping != nullptr) {
+		CloseHandle(mMapping);
+	}
+	if (mFile != nullptr) {
+		CloseHandle(mFile);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mFile = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+	mFd = ::open(fileName.c_str(), O_RDONLY);
+	if (mFd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(mFd, &st) != 0) {
+		close();
+		return false;
+	}
+	// an empty file cannot be mapped
+	if (st.st_size == 0) {
+		return true;
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, mFd, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+	mData = static_cast<const char*>(data);
+	mSize = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData != nullptr) {
+		munmap(const_cast<char*>(mData), mSize);
+	}
+	if (mFd >= 0) {
+		::close(mFd);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mFd = -1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Whole file mapped read only in memory
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// false if the file cannot be opened, an empty file has no data and size 0
+	bool open(const std::string& fileName);
+
+	void close();
+
+	const char* data() const { return mData; }
+
+	size_t size() const { return mSize; }
+
+private:
+	const char* mData = nullptr;
+	size_t mSize = 0;
+
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFd = -1;
+#endif
+};
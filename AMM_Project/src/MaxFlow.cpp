@@ -0,0 +1,95 @@
+#include "MaxFlow.h"
+
+#include <algorithm>
+#include <limits>
+
+MaxFlow::MaxFlow(uint32_t numNodes) : mNumNodes(numNodes), mLevel(numNodes), mCurrentEdge(numNodes)
+{
+
+}
+
+void MaxFlow::addEdge(uint32_t from, uint32_t to, int64_t capacity)
+{
+	mAdded.push_back({ from, to, capacity });
+}
+
+int64_t MaxFlow::solve(uint32_t source, uint32_t sink)
+{
+	if (mFirstEdge.empty()) {
+		buildEdges();
+	}
+	int64_t flow = 0;
+	while (buildLevels(source, sink)) {
+		std::copy(mFirstEdge.begin(), mFirstEdge.end() - 1, mCurrentEdge.begin());
+		flow += augment(source, sink, std::numeric_limits<int64_t>::max());
+	}
+	return flow;
+}
+
+void MaxFlow::buildEdges()
+{
+	// every edge and its residual, counted then placed by node
+	mFirstEdge.assign(mNumNodes + 1, 0);
+	for (const AddedEdge& added : mAdded) {
+		++mFirstEdge[added.from + 1];
+		++mFirstEdge[added.to + 1];
+	}
+	for (uint32_t n = 0; n < mNumNodes; ++n) {
+		mFirstEdge[n + 1] += mFirstEdge[n];
+	}
+	std::vector<uint32_t> next(mFirstEdge.begin(), mFirstEdge.end() - 1);
+	mEdges.resize(2 * mAdded.size());
+	for (const AddedEdge& added : mAdded) {
+		const uint32_t forward = next[added.from]++;
+		const uint32_t backward = next[added.to]++;
+		mEdges[forward] = { added.to, backward, added.capacity };
+		mEdges[backward] = { added.from, forward, 0 };
+	}
+}
+
+bool MaxFlow::buildLevels(uint32_t source, uint32_t sink)
+{
+	std::fill(mLevel.begin(), mLevel.end(), -1);
+	std::vector<uint32_t> queue;
+	queue.reserve(mNumNodes);
+	queue.push_back(source);
+	mLevel[source] = 0;
+	for (size_t head = 0; head < queue.size(); ++head) {
+		const uint32_t node = queue[head];
+		for (uint32_t e = mFirstEdge[node]; e < mFirstEdge[node + 1]; ++e) {
+			const Edge& edge = mEdges[e];
+			if (edge.capacity > 0 && mLevel[edge.to] < 0) {
+				mLevel[edge.to] = mLevel[node] + 1;
+				queue.push_back(edge.to);
+			}
+		}
+	}
+	return mLevel[sink] >= 0;
+}
+
+int64_t MaxFlow::augment(uint32_t node, uint32_t sink, int64_t limit)
+{
+	if (node == sink) {
+		return limit;
+	}
+	// pushes along the admissible edges until limit is used, an edge stays current
+	// while it may take more
+	int64_t total = 0;
+	for (uint32_t& e = mCurrentEdge[node]; e < mFirstEdge[node + 1]; ++e) {
+		Edge& edge = mEdges[e];
+		if (edge.capacity > 0 && mLevel[edge.to] == mLevel[node] + 1) {
+			const int64_t pushed = augment(edge.to, sink, std::min(limit - total, edge.capacity));
+			edge.capacity -= pushed;
+			mEdges[edge.reverse].capacity += pushed;
+			total += pushed;
+			if (total == limit) {
+				break;
+			}
+		}
+	}
+	// a node that cannot take more leaves the level graph
+	if (total < limit) {
+		mLevel[node] = -1;
+	}
+	return total;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Maximum flow by Dinic's algorithm on integer capacities. The edges are grouped
+// by node before the first solve, so that a phase reads them in order
+class MaxFlow
+{
+public:
+
+	explicit MaxFlow(uint32_t numNodes);
+
+	// Not after solve()
+	void addEdge(uint32_t from, uint32_t to, int64_t capacity);
+
+	// Flow from source to sink, the edges keep it until the next call
+	int64_t solve(uint32_t source, uint32_t sink);
+
+	size_t getNumEdges() const { return mAdded.size(); }
+
+private:
+
+	typedef struct AddedEdge
+	{
+		uint32_t from;
+		uint32_t to;
+		int64_t capacity;
+
+	} AddedEdge;
+
+	typedef struct Edge
+	{
+		uint32_t to;
+		// index of the residual edge in mEdges
+		uint32_t reverse;
+		int64_t capacity;
+
+	} Edge;
+
+	uint32_t mNumNodes;
+	std::vector<AddedEdge> mAdded;
+
+	// edges of node n are in [mFirstEdge[n], mFirstEdge[n + 1])
+	std::vector<uint32_t> mFirstEdge;
+	std::vector<Edge> mEdges;
+
+	// distance from the source in the level graph, -1 if not reached
+	std::vector<int32_t> mLevel;
+	// first edge of each node not yet used up in the current phase
+	std::vector<uint32_t> mCurrentEdge;
+
+	void buildEdges();
+
+	bool buildLevels(uint32_t source, uint32_t sink);
+
+	int64_t augment(uint32_t node, uint32_t sink, int64_t limit);
+};
@@ -1,105 +1,476 @@
 #include "Model.h"
+#include "MappedFile.h"
 
 #include <fstream>
-#include <cassert>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace
+{
+    // vectors filled by the text parser
+    typedef struct TextStorage
+    {
+        std::vector<City> cities;
+        std::vector<vec> centerPos;
+        std::vector<CenterType> centerTypes;
+    } TextStorage;
+
+    const char BINARY_MAGIC[8] = { 'A', 'M', 'M', 'B', 'I', 'N', '\r', '\n' };
+    const uint32_t BINARY_VERSION = 1;
+
+    typedef struct BinaryHeader
+    {
+        char magic[8];
+        // also tells apart files written with another byte order
+        uint32_t version;
+        uint32_t numCities;
+        uint32_t numLocations;
+        uint32_t numTypes;
+        float minDistBetweenCenters;
+        uint32_t reserved;
+    } BinaryHeader;
+
+    // the arrays are written and mapped as they are in memory
+    static_assert(sizeof(BinaryHeader) == 32, "unexpected binary header layout");
+    static_assert(sizeof(City) == 12 && std::is_trivially_copyable<City>::value, "unexpected City layout");
+    static_assert(sizeof(vec) == 8 && std::is_trivially_copyable<vec>::value, "unexpected vec layout");
+    static_assert(sizeof(CenterType) == 12 && std::is_trivially_copyable<CenterType>::value, "unexpected CenterType layout");
+
+    // Tokenizer of OPL .dat text: statements "name = value;" where values are
+    // numbers or [ ] arrays, blanks, commas and comments separate tokens
+    class DatParser
+    {
+    public:
+        DatParser(const char* begin, const char* end) : mBegin(begin), mPos(begin), mEnd(end) {}
+
+        // Reads "name =", false at the end of the text or on error
+        bool nextStatement(std::string_view& name)
+        {
+            if (!skipBlanks()) {
+                return false;
+            }
+            const char* start = mPos;
+            while (mPos != mEnd && (std::isalnum(static_cast<unsigned char>(*mPos)) || *mPos == '_')) {
+                ++mPos;
+            }
+            if (mPos == start) {
+                return fail("expected a parameter name");
+            }
+            name = std::string_view(start, mPos - start);
+            mSection = std::string(name);
+            return expect('=');
+        }
+
+        bool expect(const char c)
+        {
+            if (!skipBlanks()) {
+                return fail(std::string("unexpected end of file, expected '") + c + "'");
+            }
+            if (*mPos != c) {
+                return fail(std::string("expected '") + c + "'");
+            }
+            ++mPos;
+            return true;
+        }
+
+        template<typename T>
+        bool readNumber(T& value)
+        {
+            if (!skipBlanks()) {
+                return fail("unexpected end of file, expected a number");
+            }
+            const std::from_chars_result res = std::from_chars(mPos, mEnd, value);
+            if (res.ec != std::errc() || (res.ptr != mEnd && !isSeparator(*res.ptr))) {
+                return fail("malformed number");
+            }
+            mPos = res.ptr;
+            return true;
+        }
+
+        bool readPoint(vec& pos)
+        {
+            return expect('[') && readNumber(pos.x) && readNumber(pos.y) && expect(']');
+        }
+
+        // Reads "[ v0 ... vn-1 ]" calling readValue(i) for each value
+        template<typename F>
+        bool readArray(const size_t n, F readValue)
+        {
+            if (!expect('[')) {
+                return false;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (!readValue(i)) {
+                    return false;
+                }
+            }
+            if (skipBlanks() && *mPos != ']') {
+                return fail("more than " + std::to_string(n) + " values");
+            }
+            return expect(']');
+        }
+
+        // Skips the value of an unknown parameter up to its ';'
+        bool skipValue()
+        {
+            while (skipBlanks() && *mPos != ';') {
+                ++mPos;
+            }
+            return mPos != mEnd || fail("unexpected end of file, expected ';'");
+        }
+
+        bool requireDefined(const bool defined, const char* name)
+        {
+            return defined || fail(std::string(name) + " has to be defined before");
+        }
+
+        // Empty unless parsing failed
+        const std::string& error() const { return mError; }
+
+    private:
+        const char* mBegin;
+        const char* mPos;
+        const char* mEnd;
+        std::string mSection;
+        std::string mError;
+
+        static bool isSeparator(const char c)
+        {
+            return std::isspace(static_cast<unsigned char>(c)) || c == ',' || c == ';' || c == ']' || c == '[' || c == '/';
+        }
+
+        // Skips blanks, commas and comments, false at the end of the text
+        bool skipBlanks()
+        {
+            while (mPos != mEnd) {
+                if (std::isspace(static_cast<unsigned char>(*mPos)) || *mPos == ',') {
+                    ++mPos;
+                }
+                else if (*mPos == '/' && mPos + 1 != mEnd && mPos[1] == '/') {
+                    mPos = std::find(mPos, mEnd, '\n');
+                }
+                else if (*mPos == '/' && mPos + 1 != mEnd && mPos[1] == '*') {
+                    const char* close = std::search(mPos + 2, mEnd, "*/", "*/" + 2);
+                    mPos = close == mEnd ? mEnd : close + 2;
+                }
+                else {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool fail(const std::string& what)
+        {
+            if (mError.empty()) {
+                const long line = 1 + static_cast<long>(std::count(mBegin, mPos, '\n'));
+                mError = std::to_string(line) + ": " + (mSection.empty() ? "" : mSection + ": ") + what;
+            }
+            return false;
+        }
+    };
+}
 
 bool Model::readFromFile(const std::string& fileName)
 {
+    char magic[sizeof(BINARY_MAGIC)] = {};
+    {
+        std::ifstream stream(fileName, std::ifstream::in | std::ifstream::binary);
+        if (!stream)
+        {
+            return false;
+        }
+        stream.read(magic, sizeof(magic));
+    }
+    if (std::memcmp(magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0) {
+        return readBinary(fileName);
+    }
+    return readText(fileName);
+}
 
-    std::ifstream stream(fileName, std::ifstream::in);
+bool Model::readBinary(const std::string& fileName)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(fileName) || file->size() < sizeof(BinaryHeader)) {
+        return false;
+    }
 
+    BinaryHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (header.version != BINARY_VERSION) {
+        std::cerr << "Unsupported binary instance version in " << fileName << std::endl;
+        return false;
+    }
+    const size_t citiesOffset = sizeof(BinaryHeader);
+    const size_t locationsOffset = citiesOffset + sizeof(City) * header.numCities;
+    const size_t typesOffset = locationsOffset + sizeof(vec) * header.numLocations;
+    const size_t fileSize = typesOffset + sizeof(CenterType) * header.numTypes;
+    if (file->size() != fileSize) {
+        std::cerr << "Truncated binary instance " << fileName << std::endl;
+        return false;
+    }
+
+    // every offset is a multiple of 4 from the page aligned start of the mapping
+    mCities = ArrayView<City>(reinterpret_cast<const City*>(file->data() + citiesOffset), header.numCities);
+    mLocations = ArrayView<vec>(reinterpret_cast<const vec*>(file->data() + locationsOffset), header.numLocations);
+    mCenterTypes = ArrayView<CenterType>(reinterpret_cast<const CenterType*>(file->data() + typesOffset), header.numTypes);
+    minDistBetweenCenters = header.minDistBetweenCenters;
+    mStorage = file;
+    mSoA = std::make_shared<SoAData>();
+    return true;
+}
+
+const Model::SoAData& Model::getSoA() const
+{
+    SoAData& soa = *mSoA;
+    std::call_once(soa.built, [&]() {
+        soa.cityPositions.x.resize(mCities.size());
+        soa.cityPositions.y.resize(mCities.size());
+        soa.cityPopulations.resize(mCities.size());
+        for (size_t c = 0; c < mCities.size(); ++c) {
+            soa.cityPositions.x[c] = mCities[c].cityPos.x;
+            soa.cityPositions.y[c] = mCities[c].cityPos.y;
+            soa.cityPopulations[c] = mCities[c].population;
+        }
+        soa.locationPositions.x.resize(mLocations.size());
+        soa.locationPositions.y.resize(mLocations.size());
+        for (size_t l = 0; l < mLocations.size(); ++l) {
+            soa.locationPositions.x[l] = mLocations[l].x;
+            soa.locationPositions.y[l] = mLocations[l].y;
+        }
+    });
+    return soa;
+}
+
+bool Model::writeBinary(const std::string& fileName) const
+{
+    std::ofstream stream(fileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
     if (!stream)
     {
         return false;
     }
 
-    std::string op;
-    std::string tmp;
+    BinaryHeader header = {};
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.numCities = static_cast<uint32_t>(mCities.size());
+    header.numLocations = static_cast<uint32_t>(mLocations.size());
+    header.numTypes = static_cast<uint32_t>(mCenterTypes.size());
+    header.minDistBetweenCenters = minDistBetweenCenters;
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(mCities.data()), sizeof(City) * mCities.size());
+    stream.write(reinterpret_cast<const char*>(mLocations.data()), sizeof(vec) * mLocations.size());
+    stream.write(reinterpret_cast<const char*>(mCenterTypes.data()), sizeof(CenterType) * mCenterTypes.size());
+    return static_cast<bool>(stream);
+}
+
+bool Model::writeText(const std::string& fileName) const
+{
+    std::ofstream stream(fileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!stream)
+    {
+        return false;
+    }
+
+    // formatted with to_chars into a buffer that is written when full
+    std::string buffer;
+    buffer.reserve(1 << 16);
+    auto flush = [&]() {
+        stream.write(buffer.data(), buffer.size());
+        buffer.clear();
+    };
+    auto put = [&](std::string_view text) {
+        buffer.append(text.data(), text.size());
+        if (buffer.size() >= (1 << 16) - 64) {
+            flush();
+        }
+    };
+    auto putNumber = [&](auto value) {
+        char digits[32];
+        const std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), value);
+        put(std::string_view(digits, static_cast<size_t>(res.ptr - digits)));
+    };
+
+    put("nLocations = ");
+    putNumber(mLocations.size());
+    put(";\nnCities = ");
+    putNumber(mCities.size());
+    put(";\nnTypes = ");
+    putNumber(mCenterTypes.size());
+    put(";\np = [");
+    for (const City& city : mCities) {
+        put(" ");
+        putNumber(city.population);
+    }
+    put(" ];\nposCities = [");
+    for (const City& city : mCities) {
+        put(" [");
+        putNumber(city.cityPos.x);
+        put(" ");
+        putNumber(city.cityPos.y);
+        put("]");
+    }
+    put(" ];\nposLocations = [");
+    for (const vec& location : mLocations) {
+        put(" [");
+        putNumber(location.x);
+        put(" ");
+        putNumber(location.y);
+        put("]");
+    }
+    put(" ];\nd_city = [");
+    for (const CenterType& type : mCenterTypes) {
+        put(" ");
+        putNumber(type.serveDist);
+    }
+    put(" ];\ncap = [");
+    for (const CenterType& type : mCenterTypes) {
+        put(" ");
+        putNumber(type.maxPop);
+    }
+    put(" ];\ncost = [");
+    for (const CenterType& type : mCenterTypes) {
+        put(" ");
+        putNumber(type.cost);
+    }
+    put(" ];\nd_center = ");
+    putNumber(minDistBetweenCenters);
+    put(";\n");
+    flush();
+    return static_cast<bool>(stream);
+}
+
+void Model::setData(std::vector<City> cities, std::vector<vec> locations, std::vector<CenterType> centerTypes, float minDist)
+{
+    std::shared_ptr<TextStorage> storage = std::make_shared<TextStorage>();
+    storage->cities = std::move(cities);
+    storage->centerPos = std::move(locations);
+    storage->centerTypes = std::move(centerTypes);
+
+    mCities = storage->cities;
+    mLocations = storage->centerPos;
+    mCenterTypes = storage->centerTypes;
+    minDistBetweenCenters = minDist;
+    mStorage = storage;
+    mSoA = std::make_shared<SoAData>();
+}
+
+bool Model::readText(const std::string& fileName)
+{
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        return false;
+    }
 
-    while (!stream.eof()) {
-        stream >> op;
-        stream >> tmp; // read the first equal....
+    DatParser parser(file.data(), file.data() + file.size());
+    std::shared_ptr<TextStorage> storage = std::make_shared<TextStorage>();
+    std::vector<City>& cities = storage->cities;
+    std::vector<vec>& centerPos = storage->centerPos;
+    std::vector<CenterType>& centerTypes = storage->centerTypes;
+    float minDist = 0.0f;
 
+    // parameters that have to appear before the arrays sized by them
+    bool hasLocations = false, hasCities = false, hasTypes = false;
+    // sections read, a file cut after a complete one must not load with zeros
+    bool hasPopulations = false, hasCityPositions = false, hasLocationPositions = false;
+    bool hasServeDists = false, hasCapacities = false, hasCosts = false, hasMinDist = false;
+    std::string_view op;
+    while (parser.nextStatement(op)) {
+        bool ok = true;
         if (op == "nLocations") {
-            int nLocations;
-            stream >> nLocations;
-            this->centerPos.resize(nLocations);
-            std::getline(stream, tmp); // ignore line
+            uint32_t nLocations;
+            ok = parser.readNumber(nLocations);
+            centerPos.resize(nLocations);
+            hasLocations = true;
         }
         else if (op == "nCities") {
-            int nCities;
-            stream >> nCities;
-            this->cities.resize(nCities);
-            std::getline(stream, tmp); // ignore line
+            uint32_t nCities;
+            ok = parser.readNumber(nCities);
+            cities.resize(nCities);
+            hasCities = true;
         }
         else if (op == "nTypes") {
-            int nTypes;
-            stream >> nTypes;
-            this->centerTypes.resize(nTypes);
-            std::getline(stream, tmp); // ignore line
+            uint32_t nTypes;
+            ok = parser.readNumber(nTypes);
+            centerTypes.resize(nTypes);
+            hasTypes = true;
         }
         else if (op == "p") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (City& city : cities) {
-                stream >> city.population;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasCities, "nCities") &&
+                parser.readArray(cities.size(), [&](size_t i) { return parser.readNumber(cities[i].population); });
+            hasPopulations = true;
         }
         else if (op == "posCities") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (City& city : cities) {
-                stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-                stream >> city.cityPos.x;
-                stream >> city.cityPos.y;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasCities, "nCities") &&
+                parser.readArray(cities.size(), [&](size_t i) { return parser.readPoint(cities[i].cityPos); });
+            hasCityPositions = true;
         }
         else if (op == "posLocations") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (vec& pos : centerPos) {
-                stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-                stream >> pos.x;
-                stream >> pos.y;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasLocations, "nLocations") &&
+                parser.readArray(centerPos.size(), [&](size_t i) { return parser.readPoint(centerPos[i]); });
+            hasLocationPositions = true;
         }
         else if (op == "d_city") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (CenterType& type : centerTypes) {
-                float aux;
-                stream >> aux;
-                type.serveDist=aux;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasTypes, "nTypes") &&
+                parser.readArray(centerTypes.size(), [&](size_t i) { return parser.readNumber(centerTypes[i].serveDist); });
+            hasServeDists = true;
         }
         else if (op == "cap") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (CenterType& type : centerTypes) {
-                stream >> type.maxPop;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasTypes, "nTypes") &&
+                parser.readArray(centerTypes.size(), [&](size_t i) { return parser.readNumber(centerTypes[i].maxPop); });
+            hasCapacities = true;
         }
         else if (op == "cost") {
-            stream.ignore(std::numeric_limits<std::streamsize>::max(), '['); // ignore until open bracket
-            for (CenterType& type : centerTypes) {
-                stream >> type.cost;
-            }
-            std::getline(stream, tmp); // ignore line
+            ok = parser.requireDefined(hasTypes, "nTypes") &&
+                parser.readArray(centerTypes.size(), [&](size_t i) { return parser.readNumber(centerTypes[i].cost); });
+            hasCosts = true;
         }
         else if (op == "d_center") {
-            float aux;
-            stream >> aux;
-            this->minDistBetweenCenters=aux;;
-            std::getline(stream, tmp); // ignore line
+            ok = parser.readNumber(minDist);
+            hasMinDist = true;
         }
         else {
-            //ignore line
-            std::cout << "ignored: " << tmp;
-            std::getline(stream, tmp); // ignore line
-            std::cout << " " << tmp << std::endl;
+            std::cerr << "ignored: " << op << std::endl;
+            ok = parser.skipValue();
+        }
+        if (!ok || !parser.expect(';')) {
+            break;
+        }
+    }
+    if (!parser.error().empty()) {
+        std::cerr << fileName << ":" << parser.error() << std::endl;
+        return false;
+    }
+    // only the sections of the parameters that are not 0, so that an empty file loads
+    const std::pair<bool, const char*> required[] = {
+        { !cities.empty() && !hasPopulations, "p" },
+        { !cities.empty() && !hasCityPositions, "posCities" },
+        { !centerPos.empty() && !hasLocationPositions, "posLocations" },
+        { !centerTypes.empty() && !hasServeDists, "d_city" },
+        { !centerTypes.empty() && !hasCapacities, "cap" },
+        { !centerTypes.empty() && !hasCosts, "cost" },
+        { !centerPos.empty() && !hasMinDist, "d_center" }
+    };
+    for (const std::pair<bool, const char*>& section : required) {
+        if (section.first) {
+            std::cerr << fileName << ": missing section " << section.second << std::endl;
+            return false;
         }
     }
 
+    mCities = cities;
+    mLocations = centerPos;
+    mCenterTypes = centerTypes;
+    minDistBetweenCenters = minDist;
+    mStorage = storage;
+    mSoA = std::make_shared<SoAData>();
     return true;
 }
@@ -3,6 +3,11 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <memory>
+#include <mutex>
+
+#include "ArrayView.h"
+#include "DistanceKernels.h"
 
 typedef struct vec2
 {
@@ -31,29 +36,71 @@ typedef struct CenterType
 
 } CenterType, Type;
 
+// Instances are read from OPL .dat text or from the binary format written by
+// writeBinary(), which is memory mapped instead of parsed. Copies of a Model
+// share the same data
 class Model
 {
 public:
 	Model() = default;
 
+	// Detects the format of the file from its first bytes
 	bool readFromFile(const std::string& fileName);
 
-	const std::vector<City>& getCities() const { return cities; }
+	// Binary layout: header, cities, locations and center types as in memory
+	bool writeBinary(const std::string& fileName) const;
+
+	// OPL .dat text that reads back to exactly the same values
+	bool writeText(const std::string& fileName) const;
+
+	// Takes an instance built in memory, by a generator for example
+	void setData(std::vector<City> cities, std::vector<vec> locations, std::vector<CenterType> centerTypes, float minDistBetweenCenters);
+
+	ArrayView<City> getCities() const { return mCities; }
 
-	const std::vector<CenterType>& getCenterTypes() const { return centerTypes; }
+	ArrayView<CenterType> getCenterTypes() const { return mCenterTypes; }
 
-	const std::vector<vec>& getLocations() const { return centerPos; }
+	ArrayView<vec> getLocations() const { return mLocations; }
 
 	const float& getMinDistanceBetweenCenters() const { return minDistBetweenCenters; }
+
+	// Same data in SoA layout for the distance kernels, copied on the first call
+	const PointsSoA& getCityPositions() const { return getSoA().cityPositions; }
+
+	const AlignedVector<uint32_t>& getCityPopulations() const { return getSoA().cityPopulations; }
+
+	const PointsSoA& getLocationPositions() const { return getSoA().locationPositions; }
 protected:
 
 private:
-	std::vector<City> cities;
-	
-	std::vector<vec> centerPos;
+	// owner of the memory the views point to, the parsed vectors or the mapped file
+	std::shared_ptr<const void> mStorage;
 
-	std::vector<CenterType> centerTypes;
+	ArrayView<City> mCities;
+
+	ArrayView<vec> mLocations;
+
+	ArrayView<CenterType> mCenterTypes;
 
 	float minDistBetweenCenters = 0.0f;
 
+	typedef struct SoAData
+	{
+		std::once_flag built;
+		PointsSoA cityPositions;
+		AlignedVector<uint32_t> cityPopulations;
+		PointsSoA locationPositions;
+	} SoAData;
+
+	// empty until the first use, so that loading an instance copies nothing. Shared
+	// by the copies of the model, reset when new data is loaded
+	std::shared_ptr<SoAData> mSoA = std::make_shared<SoAData>();
+
+	// Fills mSoA from the views on the first call, from any thread
+	const SoAData& getSoA() const;
+
+	bool readText(const std::string& fileName);
+
+	bool readBinary(const std::string& fileName);
+
 };
\ No newline at end of file
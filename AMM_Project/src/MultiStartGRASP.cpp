@@ -0,0 +1,425 @@
+#include "MultiStartGRASP.h"
+#include "SimulatedAnnealing.h"
+#include "Instrumentation.h"
+
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+	// starts between two updates of the reactive GRASP probabilities
+	const uint64_t REACTIVE_PERIOD = 20;
+
+	// exponent of the ratio of the best cost to the mean cost of an alpha
+	const double REACTIVE_AMPLIFICATION = 10.0;
+
+	// no alpha drawn before falls under this share of the most likely one, so that
+	// a few unlucky starts do not rule it out
+	const double REACTIVE_MIN_RATIO = 0.02;
+
+	// last word of the seed sequence of the alpha of a start, so that it differs from
+	// the seed of the start
+	const uint32_t ALPHA_SEED_TAG = 1;
+}
+
+MultiStartGRASP::MultiStartGRASP(const GreedyModel& model, int numReplicas, int threadsPerReplica) :
+	mNextIteration(0),
+	mCompletedIterations(0),
+	mStopRequested(false),
+	mPool(0, 4),
+	mCompletedRelinkings(0),
+	mInfeasibleStarts(0),
+	mReportedCost(std::numeric_limits<float>::infinity()),
+	mBestCost(std::numeric_limits<float>::infinity()),
+	mBestIteration(0)
+{
+	numReplicas = std::max(1, numReplicas);
+	mReplicas.reserve(numReplicas);
+	for (int r = 0; r < numReplicas; ++r) {
+		mReplicas.push_back(model);
+		mReplicas.back().setNumThreads(threadsPerReplica);
+	}
+}
+
+void MultiStartGRASP::run(float alpha, const SolverLimits& limits, uint32_t seed, const ProgressCallback& callback)
+{
+	mNextIteration = 0;
+	mCompletedIterations = 0;
+	mCompletedRelinkings = 0;
+	mInfeasibleStarts = 0;
+	mStopRequested = false;
+	{
+		std::lock_guard<std::mutex> lock(mBestMutex);
+		mBest = mIncumbent;
+		mHasBest = mHasIncumbent;
+		mBestCost = mHasIncumbent ? mIncumbent.cost : std::numeric_limits<float>::infinity();
+		// before every start, so that it wins the ties
+		mBestIteration = 0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mPoolMutex);
+		mPool.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mAlphaMutex);
+		mAlphaProbabilities = mInitialProbabilities;
+		mAlphaStarts.assign(mAlphas.size(), 0);
+		mAlphaInfeasibleStarts.assign(mAlphas.size(), 0);
+		mAlphaCostSum.assign(mAlphas.size(), 0.0);
+		mStartsSinceUpdate = 0;
+	}
+	mStart = std::chrono::steady_clock::now();
+	mCallback = callback;
+	mReportedCost = mBestCost.load();
+
+	for (GreedyModel& replica : mReplicas) {
+		replica.setDeadline(limits.deadline);
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(mReplicas.size() - 1);
+	for (size_t r = 1; r < mReplicas.size(); ++r) {
+		threads.emplace_back(&MultiStartGRASP::runReplica, this, std::ref(mReplicas[r]), alpha, std::cref(limits), seed);
+	}
+	runReplica(mReplicas[0], alpha, limits, seed);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	mCallback = nullptr;
+}
+
+void MultiStartGRASP::setIncumbent(const GreedyModel& model)
+{
+	mHasIncumbent = model.isSolution();
+	if (mHasIncumbent) {
+		mIncumbent = model.getSolution();
+	}
+}
+
+void MultiStartGRASP::run(float alpha, double maxSeconds, uint64_t maxIterations, uint32_t seed)
+{
+	SolverLimits limits;
+	limits.deadline = deadlineAfter(std::chrono::steady_clock::now(), maxSeconds);
+	limits.maxIterations = maxIterations;
+	run(alpha, limits, seed);
+}
+
+void MultiStartGRASP::runAnnealing(const SolverLimits& limits, uint32_t seed, const ProgressCallback& callback)
+{
+	mCompletedIterations = 0;
+	mStopRequested = false;
+	mStart = std::chrono::steady_clock::now();
+	mCallback = callback;
+	mReportedCost = mBestCost.load();
+
+	Solution start;
+	const bool hasStart = getBestSolution(start);
+
+	auto runChain = [&](const uint32_t r) {
+		GreedyModel& replica = mReplicas[r];
+		replica.setDeadline(limits.deadline);
+		if (hasStart) {
+			replica.setSolution(start);
+		}
+		else {
+			replica.purge();
+			replica.GRASPConstructivePhase(0.0f);
+		}
+
+		SimulatedAnnealing annealing(replica);
+		// never the seed of a GRASP start
+		std::seed_seq seq{ seed, r, std::numeric_limits<uint32_t>::max() };
+		uint32_t chainSeed;
+		seq.generate(&chainSeed, &chainSeed + 1);
+		annealing.setSeed(chainSeed);
+		annealing.run(limits.deadline, limits.maxIterations, [&](const GreedyModel& model, bool improved) {
+			// numbered after the GRASP starts, so that ties keep their solutions
+			if (improved && model.isSolution()) {
+				offer(model, mNextIteration.fetch_add(1), annealing.getCycles());
+			}
+			return !mStopRequested.load() && mBestCost.load() > limits.targetCost;
+		});
+		mCompletedIterations.fetch_add(annealing.getCycles());
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(mReplicas.size() - 1);
+	for (uint32_t r = 1; r < mReplicas.size(); ++r) {
+		threads.emplace_back(runChain, r);
+	}
+	runChain(0);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	mCallback = nullptr;
+}
+
+void MultiStartGRASP::setPathRelinking(size_t poolSize, uint32_t relinkPeriod, uint32_t minDistance)
+{
+	std::lock_guard<std::mutex> lock(mPoolMutex);
+	mPool = ElitePool(poolSize, minDistance);
+	mRelinkPeriod = relinkPeriod;
+}
+
+void MultiStartGRASP::setReactiveAlphas(const std::vector<float>& alphas, const std::vector<float>& weights)
+{
+	std::lock_guard<std::mutex> lock(mAlphaMutex);
+	mAlphas = alphas;
+	mInitialProbabilities.assign(alphas.size(), 1.0);
+	if (weights.size() == alphas.size()) {
+		for (size_t a = 0; a < alphas.size(); ++a) {
+			mInitialProbabilities[a] = std::max(0.0f, weights[a]);
+		}
+	}
+	double sum = std::accumulate(mInitialProbabilities.begin(), mInitialProbabilities.end(), 0.0);
+	if (!(sum > 0.0)) {
+		mInitialProbabilities.assign(alphas.size(), 1.0);
+		sum = static_cast<double>(alphas.size());
+	}
+	for (double& probability : mInitialProbabilities) {
+		probability /= sum;
+	}
+	mAlphaProbabilities = mInitialProbabilities;
+	mAlphaStarts.assign(alphas.size(), 0);
+	mAlphaInfeasibleStarts.assign(alphas.size(), 0);
+	mAlphaCostSum.assign(alphas.size(), 0.0);
+	mStartsSinceUpdate = 0;
+}
+
+std::vector<AlphaStats> MultiStartGRASP::getAlphaStats() const
+{
+	std::lock_guard<std::mutex> lock(mAlphaMutex);
+	std::vector<AlphaStats> stats(mAlphas.size());
+	for (size_t a = 0; a < mAlphas.size(); ++a) {
+		const uint64_t feasibleStarts = mAlphaStarts[a] - mAlphaInfeasibleStarts[a];
+		stats[a].alpha = mAlphas[a];
+		stats[a].probability = static_cast<float>(mAlphaProbabilities[a]);
+		stats[a].starts = mAlphaStarts[a];
+		stats[a].infeasibleStarts = mAlphaInfeasibleStarts[a];
+		stats[a].meanCost = feasibleStarts != 0 ? static_cast<float>(mAlphaCostSum[a] / feasibleStarts) : std::numeric_limits<float>::infinity();
+	}
+	return stats;
+}
+
+uint32_t MultiStartGRASP::drawAlpha(uint32_t value) const
+{
+	const double u = static_cast<double>(value) / 4294967296.0;
+	std::lock_guard<std::mutex> lock(mAlphaMutex);
+	double cumulative = 0.0;
+	for (uint32_t a = 0; a + 1 < mAlphaProbabilities.size(); ++a) {
+		cumulative += mAlphaProbabilities[a];
+		if (u < cumulative) {
+			return a;
+		}
+	}
+	return static_cast<uint32_t>(mAlphaProbabilities.size() - 1);
+}
+
+void MultiStartGRASP::recordAlpha(uint32_t a, bool feasible, float cost)
+{
+	std::lock_guard<std::mutex> lock(mAlphaMutex);
+	++mAlphaStarts[a];
+	if (feasible) {
+		mAlphaCostSum[a] += cost;
+	}
+	else {
+		++mAlphaInfeasibleStarts[a];
+	}
+	if (++mStartsSinceUpdate < REACTIVE_PERIOD) {
+		return;
+	}
+	mStartsSinceUpdate = 0;
+	const double bestCost = mBestCost.load();
+	if (!std::isfinite(bestCost)) {
+		return;
+	}
+
+	// the alphas not drawn yet keep their probability
+	std::vector<double> quality(mAlphas.size(), 0.0);
+	double drawnProbability = 0.0;
+	double maxQuality = 0.0;
+	for (size_t i = 0; i < mAlphas.size(); ++i) {
+		if (mAlphaStarts[i] == 0) {
+			continue;
+		}
+		drawnProbability += mAlphaProbabilities[i];
+		const uint64_t feasibleStarts = mAlphaStarts[i] - mAlphaInfeasibleStarts[i];
+		if (feasibleStarts != 0) {
+			const double meanCost = mAlphaCostSum[i] / feasibleStarts;
+			quality[i] = std::pow(bestCost / meanCost, REACTIVE_AMPLIFICATION) * feasibleStarts / mAlphaStarts[i];
+			maxQuality = std::max(maxQuality, quality[i]);
+		}
+	}
+	if (!(maxQuality > 0.0)) {
+		return;
+	}
+	double qualitySum = 0.0;
+	for (size_t i = 0; i < mAlphas.size(); ++i) {
+		if (mAlphaStarts[i] != 0) {
+			quality[i] = std::max(quality[i], REACTIVE_MIN_RATIO * maxQuality);
+			qualitySum += quality[i];
+		}
+	}
+	for (size_t i = 0; i < mAlphas.size(); ++i) {
+		if (mAlphaStarts[i] != 0) {
+			mAlphaProbabilities[i] = drawnProbability * quality[i] / qualitySum;
+		}
+	}
+}
+
+void MultiStartGRASP::stop()
+{
+	mStopRequested = true;
+}
+
+void MultiStartGRASP::runReplica(GreedyModel& replica, float alpha, const SolverLimits& limits, uint32_t seed)
+{
+	while (!mStopRequested.load() && mBestCost.load() > limits.targetCost && std::chrono::steady_clock::now() < limits.deadline) {
+		const uint64_t iteration = mNextIteration.fetch_add(1);
+		if (limits.maxIterations != 0 && iteration >= limits.maxIterations) {
+			break;
+		}
+		AMM_ITERATION_SCOPE();
+
+		std::seed_seq seq{ seed, static_cast<uint32_t>(iteration), static_cast<uint32_t>(iteration >> 32) };
+		uint32_t iterationSeed;
+		seq.generate(&iterationSeed, &iterationSeed + 1);
+		replica.setSeed(iterationSeed);
+
+		const bool relinkStart = mRelinkPeriod != 0 && iteration % mRelinkPeriod == mRelinkPeriod - 1;
+		const bool relinked = relinkStart && relink(replica, iterationSeed);
+		// a failed relinking leaves an ordinary start, drawing the same numbers
+		if (relinkStart && !relinked) {
+			replica.setSeed(iterationSeed);
+		}
+		const bool reactive = !relinked && !mAlphas.empty();
+		uint32_t alphaIndex = 0;
+		if (reactive) {
+			std::seed_seq alphaSeq{ seed, static_cast<uint32_t>(iteration), static_cast<uint32_t>(iteration >> 32), ALPHA_SEED_TAG };
+			uint32_t alphaValue;
+			alphaSeq.generate(&alphaValue, &alphaValue + 1);
+			alphaIndex = drawAlpha(alphaValue);
+		}
+		if (relinked) {
+			mCompletedRelinkings.fetch_add(1);
+		}
+		else {
+			replica.purge();
+			// a start cut by the deadline is dropped and not counted
+			if (!replica.GRASPConstructivePhase(reactive ? mAlphas[alphaIndex] : alpha)) {
+				break;
+			}
+			replica.runParallelLocalSearch();
+			// the descent needs every role assigned, and no assignment to these centers does
+			if (replica.getLastRepair() == GreedyModel::RepairResult::Infeasible) {
+				mInfeasibleStarts.fetch_add(1);
+			}
+			else {
+				replica.runNeighbourhoodDescent();
+			}
+		}
+		mCompletedIterations.fetch_add(1);
+
+		const bool feasible = replica.isSolution();
+		if (feasible) {
+			offer(replica, iteration, iteration);
+			const Solution solution = replica.getSolution();
+			std::lock_guard<std::mutex> lock(mPoolMutex);
+			mPool.offer(solution);
+		}
+		if (reactive) {
+			recordAlpha(alphaIndex, feasible, replica.getCentersCost());
+		}
+	}
+}
+
+bool MultiStartGRASP::relink(GreedyModel& replica, uint32_t seed)
+{
+	Solution start;
+	Solution guide;
+	{
+		std::lock_guard<std::mutex> lock(mPoolMutex);
+		if (mPool.size() < 2) {
+			return false;
+		}
+		// the seed of the start picks the members and the direction
+		std::mt19937 rng(seed);
+		const size_t a = rng() % mPool.size();
+		size_t b = rng() % (mPool.size() - 1);
+		b += b >= a ? 1 : 0;
+		start = mPool[a];
+		guide = mPool[b];
+	}
+	replica.setSolution(start);
+	return replica.runPathRelinking(guide);
+}
+
+void MultiStartGRASP::offer(const GreedyModel& replica, uint64_t iteration, uint64_t reportedIteration)
+{
+	const float cost = replica.getCentersCost();
+	if (cost > mBestCost.load()) {
+		return;
+	}
+	bool improved;
+	SolverProgress progress;
+	{
+		std::lock_guard<std::mutex> lock(mBestMutex);
+		improved = cost < mBestCost.load();
+		if (improved || (cost == mBestCost.load() && iteration < mBestIteration)) {
+			mBest = replica.getSolution();
+			mHasBest = true;
+			mBestCost = cost;
+			mBestIteration = iteration;
+		}
+		progress.cost = cost;
+		progress.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+		progress.iteration = reportedIteration;
+	}
+	if (!improved || !mCallback) {
+		return;
+	}
+
+	// another thread may have reported a better solution since the lock was released
+	std::lock_guard<std::mutex> lock(mCallbackMutex);
+	if (progress.cost < mReportedCost) {
+		mReportedCost = progress.cost;
+		mCallback(progress);
+	}
+}
+
+bool MultiStartGRASP::getBestSolution(Solution& solution) const
+{
+	std::lock_guard<std::mutex> lock(mBestMutex);
+	if (!mHasBest) {
+		return false;
+	}
+	solution = mBest;
+	return true;
+}
+
+const Solution* MultiStartGRASP::getBest() const
+{
+	return mHasBest ? &mBest : nullptr;
+}
+
+float MultiStartGRASP::getBestCost() const
+{
+	return mBestCost.load();
+}
+
+uint64_t MultiStartGRASP::getIterations() const
+{
+	return mCompletedIterations.load();
+}
+
+uint64_t MultiStartGRASP::getRelinkings() const
+{
+	return mCompletedRelinkings.load();
+}
+
+uint64_t MultiStartGRASP::getInfeasibleStarts() const
+{
+	return mInfeasibleStarts.load();
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "GreedyModel.h"
+#include "ElitePool.h"
+
+// When a run stops, whichever comes first
+typedef struct SolverLimits
+{
+	// no start begins after it, and the local search of the running ones stops
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+	// 0 for no cap
+	uint64_t maxIterations = 0;
+
+	// stop once a feasible solution costs this or less
+	float targetCost = -std::numeric_limits<float>::infinity();
+
+} SolverLimits;
+
+// start + seconds, or no deadline if that is not representable
+inline std::chrono::steady_clock::time_point deadlineAfter(std::chrono::steady_clock::time_point start, double seconds)
+{
+	if (!(seconds < std::chrono::duration<double>(std::chrono::steady_clock::time_point::max() - start).count())) {
+		return std::chrono::steady_clock::time_point::max();
+	}
+	return start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(seconds, 0.0)));
+}
+
+typedef struct SolverProgress
+{
+	float cost;
+
+	// since the run started
+	double seconds;
+
+	// the start that found the solution, or the annealing cycle
+	uint64_t iteration;
+
+} SolverProgress;
+
+// Called on every improvement of the best solution, from the thread that found it.
+// Calls never overlap and their costs are strictly decreasing
+typedef std::function<void(const SolverProgress&)> ProgressCallback;
+
+// What reactive GRASP learned about one alpha
+typedef struct AlphaStats
+{
+	float alpha;
+
+	// of drawing it for the next start
+	float probability;
+
+	uint64_t starts;
+
+	// starts that ended without a feasible solution
+	uint64_t infeasibleStarts;
+
+	// of the feasible starts, infinity if there is none
+	float meanCost;
+
+} AlphaStats;
+
+// Runs GRASP starts on one GreedyModel replica per thread and keeps the best
+// feasible solution found by any of them. With setPathRelinking the starts also fill
+// an elite pool of good and diverse solutions, and some of them relink two of its
+// members instead
+class MultiStartGRASP
+{
+public:
+
+	MultiStartGRASP(const GreedyModel& model, int numReplicas, int threadsPerReplica = 1);
+
+	// Runs starts until a limit is reached or stop() is called. Start i draws its random
+	// choices from a generator seeded with (seed, i), so with an iteration cap and no
+	// other limit the result only depends on the seed. With path relinking or reactive
+	// alphas and more than one replica it also depends on the order the starts finish
+	void run(float alpha, const SolverLimits& limits, uint32_t seed, const ProgressCallback& callback = nullptr);
+
+	// The best solution of the next runs starts as the one of model, if it is feasible,
+	// and a start only replaces it with a cheaper one
+	void setIncumbent(const GreedyModel& model);
+
+	// Runs starts until maxSeconds elapse or maxIterations starts are done (0 for no cap)
+	void run(float alpha, double maxSeconds, uint64_t maxIterations, uint32_t seed);
+
+	// Simulated annealing from the best solution so far, or from a greedy one if there
+	// is none, with one chain per replica. maxIterations caps the cycles of each chain,
+	// and the best solution is kept and reported as in run()
+	void runAnnealing(const SolverLimits& limits, uint32_t seed, const ProgressCallback& callback = nullptr);
+
+	// Every relinkPeriod-th start relinks two members of a pool of poolSize solutions
+	// that differ in at least minDistance locations, once it has two. A pool size or a
+	// period of 0 makes every start independent, and the pool size is 0 by default
+	void setPathRelinking(size_t poolSize, uint32_t relinkPeriod, uint32_t minDistance = 4);
+
+	// Reactive GRASP: every start draws its alpha from alphas instead of using the one
+	// given to run(). Every few starts the probability of each alpha becomes
+	// proportional to (best cost / its mean cost)^10 times its share of feasible
+	// starts, shared among the alphas already drawn. weights are the initial
+	// probabilities, uniform if empty, and each run starts from them again. Empty
+	// alphas turns it off. Not to be called while running
+	void setReactiveAlphas(const std::vector<float>& alphas, const std::vector<float>& weights = {});
+
+	// One entry per alpha of setReactiveAlphas, for the last run
+	std::vector<AlphaStats> getAlphaStats() const;
+
+	// Makes a running run() or runAnnealing() return once the current starts finish,
+	// from any thread
+	void stop();
+
+	// Copies the best solution found so far, also while running, false if there is none yet
+	bool getBestSolution(Solution& solution) const;
+
+	// nullptr if no start found a feasible solution, not to be used while running
+	const Solution* getBest() const;
+
+	float getBestCost() const;
+
+	// GRASP starts or annealing cycles of the last run
+	uint64_t getIterations() const;
+
+	// starts of the last run that were path relinkings
+	uint64_t getRelinkings() const;
+
+	// starts of the last run whose open centers could not serve every role, so they
+	// skipped the descent
+	uint64_t getInfeasibleStarts() const;
+
+private:
+
+	std::vector<GreedyModel> mReplicas;
+
+	std::atomic<uint64_t> mNextIteration;
+	std::atomic<uint64_t> mCompletedIterations;
+	std::atomic<bool> mStopRequested;
+
+	ElitePool mPool;
+	uint32_t mRelinkPeriod = 4;
+	std::atomic<uint64_t> mCompletedRelinkings;
+	std::atomic<uint64_t> mInfeasibleStarts;
+	std::mutex mPoolMutex;
+
+	std::vector<float> mAlphas;
+	std::vector<double> mInitialProbabilities;
+	std::vector<double> mAlphaProbabilities;
+	std::vector<uint64_t> mAlphaStarts;
+	std::vector<uint64_t> mAlphaInfeasibleStarts;
+	std::vector<double> mAlphaCostSum;
+	uint64_t mStartsSinceUpdate = 0;
+	mutable std::mutex mAlphaMutex;
+
+	std::chrono::steady_clock::time_point mStart;
+	ProgressCallback mCallback;
+	// held while the callback runs, so that the calls never overlap
+	std::mutex mCallbackMutex;
+	// of the last call, a solution that is not better is not reported
+	float mReportedCost;
+
+	// cost of mBest, read without the lock to discard worse solutions early
+	std::atomic<float> mBestCost;
+	uint64_t mBestIteration;
+	Solution mBest;
+	bool mHasBest = false;
+	mutable std::mutex mBestMutex;
+
+	Solution mIncumbent;
+	bool mHasIncumbent = false;
+
+	void runReplica(GreedyModel& replica, float alpha, const SolverLimits& limits, uint32_t seed);
+
+	// Relinks two pool members on the replica, false if the pool has less than two or
+	// if no solution on the path is feasible
+	bool relink(GreedyModel& replica, uint32_t seed);
+
+	// Index in mAlphas of the alpha of a start, from a uniform 32-bit value
+	uint32_t drawAlpha(uint32_t value) const;
+
+	// Adds the result of a start with alpha index a and updates the probabilities
+	void recordAlpha(uint32_t a, bool feasible, float cost);
+
+	// Keeps the solution of the replica if it is better, ties go to the lowest iteration.
+	// The progress callback reports reportedIteration, and runs after mBestMutex is
+	// released so that it may read the best solution
+	void offer(const GreedyModel& replica, uint64_t iteration, uint64_t reportedIteration);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Instrumentation.h"
+
+#include <vector>
+#include <omp.h>
+
+// Work partitioning shared by the solver kernels. Iterations are handed out to
+// the threads in small chunks on demand, so uneven work (blocked locations,
+// cities with many centers in reach) does not leave threads idle.
+
+// Calls body(i) for every i in [0, n)
+template<typename Body>
+void parallelFor(int n, int numThreads, Body body, int chunk = 1)
+{
+	AMM_TIME_SCOPE(ParallelRegion);
+	#pragma omp parallel for schedule(dynamic, chunk) num_threads(numThreads) if(n > chunk)
+	for (int i = 0; i < n; ++i) {
+		body(i);
+	}
+}
+
+// Folds body(i, acc) for every i in [0, n) into one accumulator per thread,
+// starting from init, and merges them in thread order with combine(acc, other).
+// The result does not depend on the schedule as long as combine is commutative,
+// for argmax reductions that means breaking ties by index.
+template<typename T, typename Body, typename Combine>
+T parallelReduce(int n, int numThreads, const T& init, Body body, Combine combine, int chunk = 1)
+{
+	std::vector<T> partial(numThreads, init);
+	{
+		AMM_TIME_SCOPE(ParallelRegion);
+		#pragma omp parallel num_threads(numThreads) if(n > chunk)
+		{
+			T acc = init;
+			#pragma omp for schedule(dynamic, chunk) nowait
+			for (int i = 0; i < n; ++i) {
+				body(i, acc);
+			}
+			partial[omp_get_thread_num()] = acc;
+		}
+	}
+
+	AMM_TIME_SCOPE(SerialReduction);
+	T result = init;
+	for (const T& acc : partial) {
+		combine(result, acc);
+	}
+	return result;
+}
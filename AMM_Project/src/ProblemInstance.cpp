@@ -0,0 +1,170 @@
+#include "ProblemInstance.h"
+
+#include <algorithm>
+#include <initializer_list>
+
+ProblemInstance::ProblemInstance(const Model& model) :
+	mModel(model),
+	mNumLocations(static_cast<uint32_t>(model.getLocations().size())),
+	mNumTypes(static_cast<uint32_t>(model.getCenterTypes().size())),
+	mNumCities(static_cast<uint32_t>(model.getCities().size())),
+	mLocationWords((static_cast<uint32_t>(model.getLocations().size()) + 63) / 64)
+{
+	for (const CenterType& type : mModel.getCenterTypes()) {
+		mReachDist = std::max(mReachDist, 3 * type.serveDist);
+	}
+
+	std::vector<vec> cityPositions(mNumCities);
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		cityPositions[c] = mModel.getCities()[c].cityPos;
+	}
+	mCityGrid = SpatialGrid(cityPositions, mReachDist / 3);
+	mLocationGrid = SpatialGrid(mModel.getLocations(), std::max(mModel.getMinDistanceBetweenCenters(), mReachDist / 3));
+
+	const DistanceKernels& kernels = getDistanceKernels();
+	const PointsSoA& cityPoints = mModel.getCityPositions();
+	const PointsSoA& locationPoints = mModel.getLocationPositions();
+
+	// distances are compared squared, against the largest squares with the same outcome
+	mSquaredServeDist.resize(mNumTypes * 2);
+	for (uint32_t t = 0; t < mNumTypes; ++t) {
+		const float serveDist = mModel.getCenterTypes()[t].serveDist;
+		mSquaredServeDist[t * 2] = squaredRadius(serveDist);
+		mSquaredServeDist[t * 2 + 1] = squaredRadius(3 * serveDist);
+	}
+	mSquaredMinDistExclusive = squaredRadiusExclusive(mModel.getMinDistanceBetweenCenters());
+
+	// sorted lists of reachable cities, ties by index so that the order does not depend on
+	// the std::sort of the platform. The greedy fills centers in this order, so a different
+	// tie-break changes its result on instances with integer coordinates
+	mReachableStart.resize(mNumLocations + 1, 0);
+	mReachableCutoff.resize(mNumLocations * mNumTypes * 2);
+	std::vector<float> squaredDists;
+	std::vector<std::pair<float, uint32_t>> sorted;
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		const vec& pos = mModel.getLocations()[l];
+		const size_t begin = mReachableCities.size();
+		mCityGrid.forEachInRadius(pos, mReachDist, [&](const uint32_t c) {
+			mReachableCities.push_back(c);
+		});
+		const size_t n = mReachableCities.size() - begin;
+		squaredDists.resize(n);
+		kernels.squaredDistancesIndexed(cityPoints.x.data(), cityPoints.y.data(), mReachableCities.data() + begin, n, pos.x, pos.y, squaredDists.data());
+		sorted.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			sorted[i] = { squaredDists[i], mReachableCities[begin + i] };
+		}
+		std::sort(sorted.begin(), sorted.end());
+		for (size_t i = 0; i < n; ++i) {
+			squaredDists[i] = sorted[i].first;
+			mReachableCities[begin + i] = sorted[i].second;
+		}
+		for (uint32_t i = 0; i < mNumTypes * 2; ++i) {
+			const auto last = std::upper_bound(squaredDists.begin(), squaredDists.end(), mSquaredServeDist[i]);
+			mReachableCutoff[l * mNumTypes * 2 + i] = static_cast<uint32_t>(last - squaredDists.begin());
+		}
+		mReachableStart[l + 1] = static_cast<uint32_t>(mReachableCities.size());
+	}
+
+	// locations are visited in order, so each city gets them sorted
+	mReachingStart.resize(mNumCities + 1, 0);
+	for (const uint32_t c : mReachableCities) {
+		mReachingStart[c + 1] += 1;
+	}
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		mReachingStart[c + 1] += mReachingStart[c];
+	}
+	std::vector<uint32_t> fill(mReachingStart.begin(), mReachingStart.end() - 1);
+	mReachingLocations.resize(mReachableCities.size());
+	for (uint32_t l = 0; l < mNumLocations; ++l) {
+		for (uint32_t i = mReachableStart[l]; i < mReachableStart[l + 1]; ++i) {
+			mReachingLocations[fill[mReachableCities[i]]++] = l;
+		}
+	}
+
+	const uint64_t denseEntries = 2 * static_cast<uint64_t>(mNumCities) * mNumLocations * mNumTypes +
+		static_cast<uint64_t>(mNumLocations) * mNumLocations;
+	mUseSpatialIndex = denseEntries > MAX_DENSE_COMPATIBILITY_ENTRIES;
+	if (mUseSpatialIndex) {
+		// only the conflicting pairs of locations are stored
+		mConflictStart.resize(mNumLocations + 1, 0);
+		for (uint32_t l = 0; l < mNumLocations; ++l) {
+			const vec& pos = mModel.getLocations()[l];
+			const size_t begin = mConflictLocations.size();
+			mLocationGrid.forEachInRadius(pos, mModel.getMinDistanceBetweenCenters(), [&](const uint32_t l2) {
+				if (l2 != l && pos.sqDist(mModel.getLocations()[l2]) <= mSquaredMinDistExclusive) {
+					mConflictLocations.push_back(l2);
+				}
+			});
+			std::sort(mConflictLocations.begin() + begin, mConflictLocations.end());
+			mConflictStart[l + 1] = static_cast<uint32_t>(mConflictLocations.size());
+		}
+		return;
+	}
+
+	squaredDists.resize(std::max(mNumCities, mNumLocations));
+
+	// compute location conflicts, a location is compatible with itself
+	mConflictBits.resize(static_cast<size_t>(mNumLocations) * mLocationWords, 0);
+	for (uint32_t l1 = 0; l1 < mNumLocations; ++l1) {
+		const uint32_t n = mNumLocations - l1 - 1;
+		kernels.squaredDistances(locationPoints.x.data() + l1 + 1, locationPoints.y.data() + l1 + 1, n,
+			locationPoints.x[l1], locationPoints.y[l1], squaredDists.data());
+		for (uint32_t i = 0; i < n; ++i) {
+			const uint32_t l2 = l1 + 1 + i;
+			if (squaredDists[i] <= mSquaredMinDistExclusive) {
+				mConflictBits[static_cast<size_t>(l1) * mLocationWords + l2 / 64] |= uint64_t(1) << (l2 % 64);
+				mConflictBits[static_cast<size_t>(l2) * mLocationWords + l1 / 64] |= uint64_t(1) << (l1 % 64);
+			}
+		}
+	}
+
+	// compute city can be assigned to center in location of type
+	mCompatibleCityLocationType.resize(2 * mNumCities * mNumLocations * mNumTypes);
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		kernels.squaredDistances(locationPoints.x.data(), locationPoints.y.data(), mNumLocations,
+			cityPoints.x[c], cityPoints.y[c], squaredDists.data());
+		for (uint32_t l = 0; l < mNumLocations; ++l) {
+			for (uint32_t t = 0; t < mNumTypes; ++t) {
+				uint32_t idx = (((c * mNumLocations + l) * mNumTypes + t) * 2);
+				mCompatibleCityLocationType[idx] = squaredDists[l] <= mSquaredServeDist[t * 2];
+				mCompatibleCityLocationType[idx + 1] = squaredDists[l] <= mSquaredServeDist[t * 2 + 1];
+			}
+		}
+	}
+}
+
+bool ProblemInstance::isLocationPairCompatible(const uint32_t& l1, const uint32_t& l2) const
+{
+	if (mUseSpatialIndex) {
+		return l1 == l2 ||
+			mModel.getLocations()[l1].sqDist(mModel.getLocations()[l2]) > mSquaredMinDistExclusive;
+	}
+	return (mConflictBits[static_cast<size_t>(l1) * mLocationWords + l2 / 64] >> (l2 % 64) & 1) == 0;
+}
+
+bool ProblemInstance::isCityLocationTypeCompatible(
+	const uint32_t& c,
+	const uint32_t& l,
+	const uint32_t& t,
+	const uint32_t& isSecondary) const
+{
+	if (mUseSpatialIndex) {
+		return mModel.getCities()[c].cityPos.sqDist(mModel.getLocations()[l]) <= mSquaredServeDist[t * 2 + isSecondary];
+	}
+	return mCompatibleCityLocationType[(((c * mNumLocations + l) * mNumTypes + t) * 2 + isSecondary)];
+}
+
+size_t ProblemInstance::getMemoryUsage() const
+{
+	size_t bytes = mCompatibleCityLocationType.capacity() / 8 +
+		mSquaredServeDist.capacity() * sizeof(float) +
+		mConflictBits.capacity() * sizeof(uint64_t) +
+		mCityGrid.getMemoryUsage() +
+		mLocationGrid.getMemoryUsage();
+	for (const std::vector<uint32_t>* v : { &mConflictStart, &mConflictLocations, &mReachableStart, &mReachableCities,
+		&mReachableCutoff, &mReachingStart, &mReachingLocations }) {
+		bytes += v->capacity() * sizeof(uint32_t);
+	}
+	return bytes;
+}
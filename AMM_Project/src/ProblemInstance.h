@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Model.h"
+#include "SpatialGrid.h"
+#include "BitOps.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Precomputed data of an instance: compatibility tables, sorted neighbour lists
+// and spatial indexes. Built once per input and never modified afterwards, so
+// any number of models on any number of threads can share it
+class ProblemInstance
+{
+public:
+	ProblemInstance(const Model& model);
+
+	ProblemInstance(const ProblemInstance&) = delete;
+	ProblemInstance& operator=(const ProblemInstance&) = delete;
+
+	const Model& getModel() const { return mModel; }
+
+	uint32_t getNumLocations() const { return mNumLocations; }
+	uint32_t getNumTypes() const { return mNumTypes; }
+	uint32_t getNumCities() const { return mNumCities; }
+
+	// words of a row of conflict bits, and of any bitset over the locations
+	uint32_t getLocationWords() const { return mLocationWords; }
+
+	// true if the dense compatibility tables are not built
+	bool usesSpatialIndex() const { return mUseSpatialIndex; }
+
+	// max distance at which any type of center can serve a city
+	float getReachDist() const { return mReachDist; }
+
+	// squaredRadius of the serve distance of type t, or of 3 times it if isSecondary
+	float getSquaredServeDist(const uint32_t t, const uint32_t isSecondary) const { return mSquaredServeDist[t * 2 + isSecondary]; }
+
+	const SpatialGrid& getCityGrid() const { return mCityGrid; }
+	const SpatialGrid& getLocationGrid() const { return mLocationGrid; }
+
+	bool isLocationPairCompatible(const uint32_t& l1, const uint32_t& l2) const;
+
+	// Calls f(l2) for every location l2 that cannot have a center at the same time as l
+	template<typename F>
+	void forEachConflictingLocation(const uint32_t l, F f) const;
+
+	// c < mNumCities, l < mNumLocations, t < mNumTypes, isSecondary {0,1}
+	bool isCityLocationTypeCompatible(const uint32_t& c, const uint32_t& l, const uint32_t& t, const uint32_t& isSecondary) const;
+
+	// Reachable cities of l sorted by distance
+	const uint32_t* getCitiesSorted(const uint32_t l) const { return mReachableCities.data() + mReachableStart[l]; }
+
+	// The first getNumCitiesInRange(l, t, isSecondary) cities of getCitiesSorted(l)
+	// are the ones compatible with a center of type t at l
+	uint32_t getNumCitiesInRange(const uint32_t l, const uint32_t t, const uint32_t isSecondary) const { return mReachableCutoff[(l * mNumTypes + t) * 2 + isSecondary]; }
+
+	// Locations within reach of city c in increasing order, getNumLocationsInReach(c) of them
+	const uint32_t* getLocationsInReach(const uint32_t c) const { return mReachingLocations.data() + mReachingStart[c]; }
+
+	uint32_t getNumLocationsInReach(const uint32_t c) const { return mReachingStart[c + 1] - mReachingStart[c]; }
+
+	// Bytes held by the precomputed tables, without the model data
+	size_t getMemoryUsage() const;
+
+	// Instances that would need more entries than this in the dense compatibility
+	// tables answer compatibility queries through the spatial index instead
+	static constexpr uint64_t MAX_DENSE_COMPATIBILITY_ENTRIES = uint64_t(1) << 28;
+
+private:
+
+	Model mModel;
+
+	const uint32_t mNumLocations;
+	const uint32_t mNumTypes;
+	const uint32_t mNumCities;
+	const uint32_t mLocationWords;
+
+	bool mUseSpatialIndex = false;
+
+	float mReachDist = 0.0f;
+
+	// squaredRadiusExclusive of the min distance between centers
+	float mSquaredMinDistExclusive = 0.0f;
+
+	std::vector<bool> mCompatibleCityLocationType;
+
+	// indexed as t * 2 + isSecondary
+	std::vector<float> mSquaredServeDist;
+
+	SpatialGrid mCityGrid;
+	SpatialGrid mLocationGrid;
+
+	// Without mUseSpatialIndex, bit l2 of the row of l (mLocationWords words from
+	// l * mLocationWords) is set if l and l2 cannot have a center at the same time
+	AlignedVector<uint64_t> mConflictBits;
+
+	// Only with mUseSpatialIndex, locations closer than the min distance between
+	// centers to l are in [mConflictStart[l], mConflictStart[l + 1])
+	std::vector<uint32_t> mConflictStart;
+	std::vector<uint32_t> mConflictLocations;
+
+	// Cities that some type of center at l can serve, sorted by distance to l,
+	// are in [mReachableStart[l], mReachableStart[l + 1]) of mReachableCities
+	std::vector<uint32_t> mReachableStart;
+	std::vector<uint32_t> mReachableCities;
+
+	// Length of the prefix of the reachable cities of l compatible with type t,
+	// indexed as (l * mNumTypes + t) * 2 + isSecondary
+	std::vector<uint32_t> mReachableCutoff;
+
+	// Transpose of the reachable cities, locations that can serve c in increasing
+	// order are in [mReachingStart[c], mReachingStart[c + 1]) of mReachingLocations
+	std::vector<uint32_t> mReachingStart;
+	std::vector<uint32_t> mReachingLocations;
+};
+
+template<typename F>
+void ProblemInstance::forEachConflictingLocation(const uint32_t l, F f) const
+{
+	if (mUseSpatialIndex) {
+		for (uint32_t i = mConflictStart[l]; i < mConflictStart[l + 1]; ++i) {
+			f(mConflictLocations[i]);
+		}
+	}
+	else {
+		forEachSetBit(mConflictBits.data() + static_cast<size_t>(l) * mLocationWords, mLocationWords, f);
+	}
+}
@@ -0,0 +1,315 @@
+#include "SimulatedAnnealing.h"
+
+#include <algorithm>
+
+namespace
+{
+	// moves between two checks of the deadline and the callback
+	const uint64_t POLL_MOVES = 4096;
+}
+
+SimulatedAnnealing::SimulatedAnnealing(const GreedyModel& model) : GreedyModel(model)
+{
+	float meanCost = 0.0f;
+	float maxCost = 0.0f;
+	for (const CenterType& type : mBaseModel.getCenterTypes()) {
+		meanCost += type.cost / mNumTypes;
+		maxCost = std::max(maxCost, type.cost);
+	}
+	mInitialTemperature = meanCost / 25;
+	mFinalTemperature = meanCost / 1000;
+	mLoadWeight = meanCost / 2;
+	mUnassignedPenalty = 2 * maxCost;
+}
+
+void SimulatedAnnealing::setSchedule(float initialTemperature, float finalTemperature, uint64_t movesPerCycle)
+{
+	mInitialTemperature = initialTemperature;
+	mFinalTemperature = std::min(finalTemperature, initialTemperature);
+	mMovesPerCycle = std::max<uint64_t>(1, movesPerCycle);
+}
+
+void SimulatedAnnealing::setLoadWeight(float loadWeight)
+{
+	mLoadWeight = loadWeight;
+}
+
+void SimulatedAnnealing::prepare()
+{
+	// assignments to a location without a center or out of range of its type are dropped
+	for (uint32_t c = 0; c < mNumCities; ++c) {
+		std::pair<uint32_t, uint32_t>& centers = mCityCenterAssignment[c];
+		if (centers.first != NOT_ASSIGNED && (!isLocationOpen(centers.first) || !isCityLocationTypeCompatible(c, centers.first, mLocationTypeAssignment[centers.first], 0))) {
+			centers.first = NOT_ASSIGNED;
+		}
+		if (centers.second != NOT_ASSIGNED && (centers.second == centers.first || !isLocationOpen(centers.second) || !isCityLocationTypeCompatible(c, centers.second, mLocationTypeAssignment[centers.second], 1))) {
+			centers.second = NOT_ASSIGNED;
+		}
+	}
+	resetLoads();
+
+	mServedRoles.assign(mNumLocations, 0);
+	mServedSqDist.assign(2 * static_cast<size_t>(mNumLocations), 0.0f);
+	mServedSqDistExact.assign(mNumLocations, 1);
+	mOpenList.clear();
+	mOpenPos.assign(mNumLocations, NOT_ASSIGNED);
+
+	const ArrayView<City> cities = mBaseModel.getCities();
+	std::vector<std::pair<uint32_t, bool>> served;
+	forEachSetBit(mOpenCenters.data(), mLocationWords, [&](const uint32_t l) {
+		mOpenPos[l] = static_cast<uint32_t>(mOpenList.size());
+		mOpenList.push_back(l);
+
+		served.clear();
+		forEachServedCity(l, [&](const uint32_t c, const bool primary) {
+			served.push_back({ c, primary });
+		});
+		// the farthest cities of an overloaded center leave it until it fits
+		const float capacity = mBaseModel.getCenterTypes()[mLocationTypeAssignment[l]].maxPop * 10.0f;
+		while (!served.empty() && mCenterServing[l] > capacity) {
+			const std::pair<uint32_t, bool> city = served.back();
+			served.pop_back();
+			if (city.second) {
+				mCityCenterAssignment[city.first].first = NOT_ASSIGNED;
+				mCenterServing[l] -= cities[city.first].population * 10.0f;
+			}
+			else {
+				mCityCenterAssignment[city.first].second = NOT_ASSIGNED;
+				mCenterServing[l] -= static_cast<float>(cities[city.first].population);
+			}
+		}
+		mServedRoles[l] = static_cast<uint32_t>(served.size());
+		updateServedSqDist(l);
+	});
+
+	mUnassignedRoles = 0;
+	for (const std::pair<uint32_t, uint32_t>& centers : mCityCenterAssignment) {
+		mUnassignedRoles += centers.first == NOT_ASSIGNED ? 1 : 0;
+		mUnassignedRoles += centers.second == NOT_ASSIGNED ? 1 : 0;
+	}
+	mCost = getCentersCost();
+}
+
+bool SimulatedAnnealing::recordIfBest()
+{
+	if (mUnassignedRoles != 0 || (mHasBest && mCost >= mBest.cost)) {
+		return false;
+	}
+	// the running sum may have drifted, the cost of the best is summed from scratch
+	mCost = getCentersCost();
+	if (mHasBest && mCost >= mBest.cost) {
+		return false;
+	}
+	mBest = getSolution();
+	mHasBest = true;
+	return true;
+}
+
+void SimulatedAnnealing::setCenterType(const uint32_t l, const uint32_t t)
+{
+	const uint32_t oldType = mLocationTypeAssignment[l];
+	if (oldType != NOT_ASSIGNED) {
+		mCost -= mBaseModel.getCenterTypes()[oldType].cost;
+	}
+	if (t != NOT_ASSIGNED) {
+		mCost += mBaseModel.getCenterTypes()[t].cost;
+	}
+	setLocationType(l, t);
+
+	if (t != NOT_ASSIGNED && mOpenPos[l] == NOT_ASSIGNED) {
+		mOpenPos[l] = static_cast<uint32_t>(mOpenList.size());
+		mOpenList.push_back(l);
+	}
+	else if (t == NOT_ASSIGNED && mOpenPos[l] != NOT_ASSIGNED) {
+		// move the last one to the hole
+		const uint32_t last = mOpenList.back();
+		mOpenList[mOpenPos[l]] = last;
+		mOpenPos[last] = mOpenPos[l];
+		mOpenList.pop_back();
+		mOpenPos[l] = NOT_ASSIGNED;
+	}
+	if (t == NOT_ASSIGNED || oldType == NOT_ASSIGNED) {
+		mCenterServing[l] = 0.0f;
+		mServedRoles[l] = 0;
+		mServedSqDist[2 * l] = 0.0f;
+		mServedSqDist[2 * l + 1] = 0.0f;
+		mServedSqDistExact[l] = 1;
+	}
+}
+
+bool SimulatedAnnealing::tryMoveCity(const float temperature)
+{
+	const uint32_t c = mRng() % mNumCities;
+	const uint32_t numReaching = getNumLocationsInReach(c);
+	if (numReaching == 0) {
+		return false;
+	}
+	const uint32_t draw = mRng();
+	const uint32_t l = getLocationsInReach(c)[(draw >> 1) % numReaching];
+	const bool primary = (draw & 1) != 0;
+	uint32_t& assigned = primary ? mCityCenterAssignment[c].first : mCityCenterAssignment[c].second;
+	const uint32_t other = primary ? mCityCenterAssignment[c].second : mCityCenterAssignment[c].first;
+	if (l == assigned || l == other || !isLocationOpen(l)) {
+		return false;
+	}
+
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	const uint32_t role = primary ? 0 : 1;
+	const uint32_t type = mLocationTypeAssignment[l];
+	const float demand = mBaseModel.getCities()[c].population * (primary ? 10.0f : 1.0f);
+	const float newLoad = mCenterServing[l] + demand;
+	if (newLoad > types[type].maxPop * 10.0f || !isCityLocationTypeCompatible(c, l, type, role)) {
+		return false;
+	}
+
+	const uint32_t from = assigned;
+	float delta = loadEnergy(newLoad, type) - loadEnergy(mCenterServing[l], type);
+	if (from == NOT_ASSIGNED) {
+		delta -= mUnassignedPenalty;
+	}
+	else if (mServedRoles[from] == 1) {
+		delta -= types[mLocationTypeAssignment[from]].cost + loadEnergy(mCenterServing[from], mLocationTypeAssignment[from]);
+	}
+	else {
+		delta += loadEnergy(mCenterServing[from] - demand, mLocationTypeAssignment[from]) - loadEnergy(mCenterServing[from], mLocationTypeAssignment[from]);
+	}
+	if (!accept(delta, temperature)) {
+		return false;
+	}
+	mAcceptedMoves++;
+
+	assigned = l;
+	mCenterServing[l] = newLoad;
+	mServedRoles[l]++;
+	float& sqDist = mServedSqDist[2 * l + role];
+	sqDist = std::max(sqDist, mBaseModel.getLocations()[l].sqDist(mBaseModel.getCities()[c].cityPos));
+
+	if (from == NOT_ASSIGNED) {
+		mUnassignedRoles--;
+		return true;
+	}
+	if (--mServedRoles[from] == 0) {
+		setCenterType(from, NOT_ASSIGNED);
+		return true;
+	}
+	mCenterServing[from] -= demand;
+	mServedSqDistExact[from] = 0;
+	return false;
+}
+
+bool SimulatedAnnealing::tryChangeType(const float temperature)
+{
+	if (mOpenList.empty()) {
+		return false;
+	}
+	const ArrayView<CenterType> types = mBaseModel.getCenterTypes();
+	const uint32_t l = mOpenList[mRng() % mOpenList.size()];
+	const uint32_t type = mLocationTypeAssignment[l];
+
+	// nothing is lost by closing an empty center
+	if (mServedRoles[l] == 0) {
+		mAcceptedMoves++;
+		setCenterType(l, NOT_ASSIGNED);
+		return true;
+	}
+
+	const uint32_t newType = mRng() % mNumTypes;
+	const float load = mCenterServing[l];
+	if (newType == type || load > types[newType].maxPop * 10.0f) {
+		return false;
+	}
+	auto reaches = [&]() {
+		return mServedSqDist[2 * l] <= mInstance->getSquaredServeDist(newType, 0) && mServedSqDist[2 * l + 1] <= mInstance->getSquaredServeDist(newType, 1);
+	};
+	if (!reaches()) {
+		if (mServedSqDistExact[l]) {
+			return false;
+		}
+		updateServedSqDist(l);
+		mServedSqDistExact[l] = 1;
+		if (!reaches()) {
+			return false;
+		}
+	}
+
+	const float delta = types[newType].cost - types[type].cost + loadEnergy(load, newType) - loadEnergy(load, type);
+	if (!accept(delta, temperature)) {
+		return false;
+	}
+	mAcceptedMoves++;
+	setCenterType(l, newType);
+	return true;
+}
+
+bool SimulatedAnnealing::tryOpen(const float temperature)
+{
+	// next to a city, where its cities can come from
+	const uint32_t c = mRng() % mNumCities;
+	const uint32_t numReaching = getNumLocationsInReach(c);
+	if (numReaching == 0) {
+		return false;
+	}
+	const uint32_t l = getLocationsInReach(c)[mRng() % numReaching];
+	const uint32_t type = mRng() % mNumTypes;
+	if (mAvailablePos[l] == NOT_ASSIGNED || !isCityLocationTypeCompatible(c, l, type, 1)) {
+		return false;
+	}
+	if (!accept(mBaseModel.getCenterTypes()[type].cost, temperature)) {
+		return false;
+	}
+	mAcceptedMoves++;
+	setCenterType(l, type);
+	// the cost only went up
+	return false;
+}
+
+void SimulatedAnnealing::run(std::chrono::steady_clock::time_point deadline, uint64_t maxCycles, const Callback& callback)
+{
+	prepare();
+	recordIfBest();
+
+	const float ratio = mFinalTemperature / mInitialTemperature;
+	bool running = true;
+	while (running && (maxCycles == 0 || mCycles < maxCycles)) {
+		if (mCycles != 0 && mHasBest) {
+			setSolution(mBest);
+			prepare();
+		}
+
+		float temperature = mInitialTemperature;
+		for (uint64_t move = 0; move < mMovesPerCycle; ++move) {
+			if (move % POLL_MOVES == 0) {
+				if (std::chrono::steady_clock::now() >= deadline || (callback && !callback(*this, false))) {
+					running = false;
+					break;
+				}
+				temperature = mInitialTemperature * std::pow(ratio, static_cast<float>(move) / mMovesPerCycle);
+			}
+			mMoves++;
+
+			// mostly city moves, a few type changes and openings
+			const uint32_t kind = mRng() % 64;
+			const bool changed = kind == 0 ? tryOpen(temperature) : kind < 4 ? tryChangeType(temperature) : tryMoveCity(temperature);
+			if (changed && recordIfBest() && callback && !callback(*this, true)) {
+				running = false;
+				break;
+			}
+		}
+		if (running) {
+			// the frozen state is polished with moves of several cities at once
+			runNeighbourhoodDescent();
+			prepare();
+			if (recordIfBest() && callback && !callback(*this, true)) {
+				running = false;
+			}
+			mCycles++;
+		}
+	}
+
+	if (mHasBest) {
+		setSolution(mBest);
+	}
+	else {
+		resetLoads();
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+#include "GreedyModel.h"
+
+// Simulated annealing on the assignment of a GreedyModel. The moves keep every
+// constraint except that cities may lack a center, which is penalized:
+//  - a primary or secondary assignment moves to another open center in reach,
+//    the center it leaves closes when it serves nobody else
+//  - an open center changes its type, or closes if it serves nobody
+//  - a free location in reach of a city opens with an empty center
+// They are evaluated in O(1) against the loads of the centers. Besides the cost,
+// the energy rewards full centers, so that moves emptying a center are preferred
+// over ones that spread the load. Every cycle cools from the initial to the final
+// temperature and starts from the best solution found so far
+class SimulatedAnnealing : public GreedyModel
+{
+public:
+
+	// Returns false to stop the search. Called with improved set whenever the model
+	// holds a feasible solution cheaper than any before, and without it every few
+	// thousand moves
+	typedef std::function<bool(const GreedyModel& model, bool improved)> Callback;
+
+	// Starts from the assignment of model
+	SimulatedAnnealing(const GreedyModel& model);
+
+	// Temperatures in units of cost, by default a 25th and a thousandth of the
+	// mean cost of the center types, with 2^22 moves per cycle
+	void setSchedule(float initialTemperature, float finalTemperature, uint64_t movesPerCycle);
+
+	// Energy of a full center, half the mean cost of the center types by default
+	void setLoadWeight(float loadWeight);
+
+	// Runs cycles until the deadline, maxCycles cycles (0 for no cap) or the callback
+	// stops it. The model is left with the best solution found, if any
+	void run(std::chrono::steady_clock::time_point deadline, uint64_t maxCycles, const Callback& callback = nullptr);
+
+	// nullptr if no feasible solution was found
+	const Solution* getBest() const { return mHasBest ? &mBest : nullptr; }
+
+	uint64_t getMoves() const { return mMoves; }
+	uint64_t getAcceptedMoves() const { return mAcceptedMoves; }
+	uint64_t getCycles() const { return mCycles; }
+
+private:
+
+	float mInitialTemperature;
+	float mFinalTemperature;
+	uint64_t mMovesPerCycle = uint64_t(1) << 22;
+	float mLoadWeight;
+
+	// energy of a primary or secondary assignment missing
+	float mUnassignedPenalty;
+
+	// primary and secondary assignments of each location
+	std::vector<uint32_t> mServedRoles;
+
+	// false once a city left the location, then mServedSqDist is only an upper bound
+	std::vector<char> mServedSqDistExact;
+
+	// open centers in no particular order, mOpenPos[l] is the position of l in it
+	std::vector<uint32_t> mOpenList;
+	std::vector<uint32_t> mOpenPos;
+
+	uint32_t mUnassignedRoles = 0;
+	float mCost = 0.0f;
+
+	Solution mBest;
+	bool mHasBest = false;
+
+	uint64_t mMoves = 0;
+	uint64_t mAcceptedMoves = 0;
+	uint64_t mCycles = 0;
+
+	// Drops invalid and overloading assignments and builds the move state
+	void prepare();
+
+	// Keeps the solution if it is feasible and cheaper than the best one
+	bool recordIfBest();
+
+	// setLocationType that keeps the open list and the cost
+	void setCenterType(const uint32_t l, const uint32_t t);
+
+	// uniform in [0, 1)
+	float random01() { return static_cast<float>(mRng() >> 8) * (1.0f / 16777216.0f); }
+
+	bool accept(const float delta, const float temperature) { return delta <= 0.0f || random01() < std::exp(-delta / temperature); }
+
+	// the load term of the energy of a center of type t
+	float loadEnergy(const float load, const uint32_t t) const
+	{
+		const float fill = load / (mBaseModel.getCenterTypes()[t].maxPop * 10.0f);
+		return -mLoadWeight * fill * fill;
+	}
+
+	// One move of each kind, true if it changed the cost or the missing assignments
+	bool tryMoveCity(const float temperature);
+	bool tryChangeType(const float temperature);
+	bool tryOpen(const float temperature);
+};
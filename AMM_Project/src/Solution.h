@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Assignment of a model without any of the problem data, cheap to copy and keep
+typedef struct Solution
+{
+	std::vector<uint32_t> locationTypes;
+	std::vector<std::pair<uint32_t, uint32_t>> cityCenters;
+	float cost = std::numeric_limits<float>::infinity();
+
+} Solution;
+
+// What a solution violates, feasible if every count is zero
+typedef struct SolutionReport
+{
+	float cost = 0.0f;
+	bool feasible = false;
+
+	// cities without a primary or a secondary center
+	uint32_t unassignedCities = 0;
+
+	// cities whose primary and secondary center are the same
+	uint32_t sameCenterCities = 0;
+
+	// assignments to a location without a center, or out of the range of its type
+	uint32_t invalidAssignments = 0;
+
+	// centers serving more population than their type allows
+	uint32_t overloadedCenters = 0;
+
+	// centers closer than the min distance to another center
+	uint32_t conflictingCenters = 0;
+
+	// population served by each location, secondary assignments count a tenth
+	std::vector<float> centerLoads;
+
+} SolutionReport;
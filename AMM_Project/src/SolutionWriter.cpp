@@ -0,0 +1,192 @@
+#include "SolutionWriter.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string_view>
+
+namespace
+{
+	const char SOLUTION_MAGIC[8] = { 'A', 'M', 'M', 'S', 'O', 'L', '\r', '\n' };
+	const uint32_t SOLUTION_VERSION = 1;
+	const uint32_t NOT_ASSIGNED = std::numeric_limits<uint32_t>::max();
+
+	typedef struct SolutionHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numLocations;
+		uint32_t numCities;
+		float cost;
+		uint32_t feasible;
+		uint32_t unassignedCities;
+		uint32_t sameCenterCities;
+		uint32_t invalidAssignments;
+		uint32_t overloadedCenters;
+		uint32_t conflictingCenters;
+	} SolutionHeader;
+
+	static_assert(sizeof(SolutionHeader) == 48, "unexpected solution header layout");
+
+	struct FileCloser
+	{
+		void operator()(FILE* file) const { std::fclose(file); }
+	};
+
+	// Appends to a fixed buffer and hands it to the file only when full
+	class BufferedWriter
+	{
+	public:
+		explicit BufferedWriter(std::unique_ptr<FILE, FileCloser> file) : mFile(std::move(file)), mBuffer(BUFFER_SIZE) {}
+
+		void write(const void* data, size_t size)
+		{
+			if (mUsed + size > mBuffer.size()) {
+				writeBuffer();
+				if (size > mBuffer.size()) {
+					mOk = mOk && std::fwrite(data, 1, size, mFile.get()) == size;
+					return;
+				}
+			}
+			std::memcpy(mBuffer.data() + mUsed, data, size);
+			mUsed += size;
+		}
+
+		void write(std::string_view text) { write(text.data(), text.size()); }
+
+		// shortest representation that reads back to the same value
+		template<typename T>
+		void writeNumber(T value)
+		{
+			char digits[32];
+			const std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), value);
+			write(digits, static_cast<size_t>(res.ptr - digits));
+		}
+
+		void writeIndex(uint32_t value)
+		{
+			if (value == NOT_ASSIGNED) {
+				write("-1");
+			}
+			else {
+				writeNumber(value);
+			}
+		}
+
+		// false if any write failed, including the data the C library still buffered
+		bool close()
+		{
+			writeBuffer();
+			mOk = std::fflush(mFile.get()) == 0 && mOk;
+			mOk = std::fclose(mFile.release()) == 0 && mOk;
+			return mOk;
+		}
+
+	private:
+		static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+		std::unique_ptr<FILE, FileCloser> mFile;
+		std::vector<char> mBuffer;
+		size_t mUsed = 0;
+		bool mOk = true;
+
+		void writeBuffer()
+		{
+			if (mUsed != 0) {
+				mOk = mOk && std::fwrite(mBuffer.data(), 1, mUsed, mFile.get()) == mUsed;
+				mUsed = 0;
+			}
+		}
+	};
+
+	std::unique_ptr<FILE, FileCloser> openForWriting(const std::string& fileName)
+	{
+		return std::unique_ptr<FILE, FileCloser>(std::fopen(fileName.c_str(), "wb"));
+	}
+}
+
+bool writeSolutionJson(const std::string& fileName, const Model& model, const Solution& solution, const SolutionReport& report)
+{
+	std::unique_ptr<FILE, FileCloser> file = openForWriting(fileName);
+	if (!file) {
+		return false;
+	}
+	BufferedWriter out(std::move(file));
+
+	out.write("{\"cost\":");
+	out.writeNumber(report.cost);
+	out.write(report.feasible ? ",\"feasible\":true" : ",\"feasible\":false");
+	out.write(",\"unassignedCities\":");
+	out.writeNumber(report.unassignedCities);
+	out.write(",\"sameCenterCities\":");
+	out.writeNumber(report.sameCenterCities);
+	out.write(",\"invalidAssignments\":");
+	out.writeNumber(report.invalidAssignments);
+	out.write(",\"overloadedCenters\":");
+	out.writeNumber(report.overloadedCenters);
+	out.write(",\"conflictingCenters\":");
+	out.writeNumber(report.conflictingCenters);
+
+	out.write(",\n\"centers\":[");
+	bool first = true;
+	for (uint32_t l = 0; l < solution.locationTypes.size(); ++l) {
+		const uint32_t t = solution.locationTypes[l];
+		if (t == NOT_ASSIGNED) {
+			continue;
+		}
+		out.write(first ? "\n{\"location\":" : ",\n{\"location\":");
+		first = false;
+		out.writeNumber(l);
+		out.write(",\"type\":");
+		out.writeNumber(t);
+		out.write(",\"load\":");
+		out.writeNumber(report.centerLoads[l]);
+		out.write(",\"maxPop\":");
+		out.writeNumber(model.getCenterTypes()[t].maxPop);
+		out.write("}");
+	}
+
+	out.write("],\n\"cities\":[");
+	for (uint32_t c = 0; c < solution.cityCenters.size(); ++c) {
+		out.write(c == 0 ? "[" : ",[");
+		out.writeIndex(solution.cityCenters[c].first);
+		out.write(",");
+		out.writeIndex(solution.cityCenters[c].second);
+		out.write("]");
+	}
+	out.write("]}\n");
+	return out.close();
+}
+
+bool writeSolutionBinary(const std::string& fileName, const Solution& solution, const SolutionReport& report)
+{
+	std::unique_ptr<FILE, FileCloser> file = openForWriting(fileName);
+	if (!file) {
+		return false;
+	}
+	BufferedWriter out(std::move(file));
+
+	SolutionHeader header = {};
+	std::memcpy(header.magic, SOLUTION_MAGIC, sizeof(SOLUTION_MAGIC));
+	header.version = SOLUTION_VERSION;
+	header.numLocations = static_cast<uint32_t>(solution.locationTypes.size());
+	header.numCities = static_cast<uint32_t>(solution.cityCenters.size());
+	header.cost = report.cost;
+	header.feasible = report.feasible ? 1 : 0;
+	header.unassignedCities = report.unassignedCities;
+	header.sameCenterCities = report.sameCenterCities;
+	header.invalidAssignments = report.invalidAssignments;
+	header.overloadedCenters = report.overloadedCenters;
+	header.conflictingCenters = report.conflictingCenters;
+
+	// the pairs are written as two consecutive uint32_t
+	static_assert(sizeof(std::pair<uint32_t, uint32_t>) == 8, "unexpected pair layout");
+
+	out.write(&header, sizeof(header));
+	out.write(solution.locationTypes.data(), sizeof(uint32_t) * solution.locationTypes.size());
+	out.write(solution.cityCenters.data(), sizeof(std::pair<uint32_t, uint32_t>) * solution.cityCenters.size());
+	out.write(report.centerLoads.data(), sizeof(float) * report.centerLoads.size());
+	return out.close();
+}
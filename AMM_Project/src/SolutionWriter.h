@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Model.h"
+#include "Solution.h"
+#include <string>
+
+// Solution files for other tools, written through a large buffer instead of one
+// stream insertion per value. Unassigned centers and locations without a center
+// are -1 in JSON and 0xffffffff in the binary file
+
+// One JSON object with the cost, the report, the open centers with their type and
+// load, and the primary and secondary center of every city
+bool writeSolutionJson(const std::string& fileName, const Model& model, const Solution& solution, const SolutionReport& report);
+
+// 48 byte header with the sizes, the cost and the report, then the location types,
+// the (primary, secondary) pairs of the cities and the center loads as in memory
+bool writeSolutionBinary(const std::string& fileName, const Solution& solution, const SolutionReport& report);
@@ -0,0 +1,71 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+
+SpatialGrid::SpatialGrid(const ArrayView<vec>& points, float cellSize)
+{
+	if (points.empty()) {
+		return;
+	}
+
+	float maxX = points[0].x, maxY = points[0].y;
+	mMinX = points[0].x;
+	mMinY = points[0].y;
+	for (const vec& p : points) {
+		mMinX = std::min(mMinX, p.x);
+		mMinY = std::min(mMinY, p.y);
+		maxX = std::max(maxX, p.x);
+		maxY = std::max(maxY, p.y);
+	}
+
+	// avoid degenerate cells, and grids with many more cells than points
+	const double width = std::max(static_cast<double>(maxX) - mMinX, 1e-3);
+	const double height = std::max(static_cast<double>(maxY) - mMinY, 1e-3);
+	mCellSize = std::max(static_cast<double>(cellSize), 1e-3);
+	const double maxCells = 4.0 * points.size() + 16.0;
+	if ((width / mCellSize + 1.0) * (height / mCellSize + 1.0) > maxCells) {
+		mCellSize = std::sqrt(width * height / maxCells) + std::max(width, height) / maxCells;
+	}
+	mNumCellsX = static_cast<uint32_t>(width / mCellSize) + 1;
+	mNumCellsY = static_cast<uint32_t>(height / mCellSize) + 1;
+
+	// counting sort of the points by cell
+	std::vector<uint32_t> pointCell(points.size());
+	mCellStart.assign(mNumCellsX * mNumCellsY + 1, 0);
+	for (uint32_t i = 0; i < points.size(); ++i) {
+		pointCell[i] = cellCoord(points[i].y, mMinY, mNumCellsY) * mNumCellsX + cellCoord(points[i].x, mMinX, mNumCellsX);
+		mCellStart[pointCell[i] + 1] += 1;
+	}
+	for (uint32_t cell = 0; cell < mNumCellsX * mNumCellsY; ++cell) {
+		mCellStart[cell + 1] += mCellStart[cell];
+	}
+
+	std::vector<uint32_t> fill(mCellStart.begin(), mCellStart.end() - 1);
+	mCellPoints.resize(points.size());
+	mCellPositions.x.resize(points.size());
+	mCellPositions.y.resize(points.size());
+	for (uint32_t i = 0; i < points.size(); ++i) {
+		const uint32_t pos = fill[pointCell[i]]++;
+		mCellPoints[pos] = i;
+		mCellPositions.x[pos] = points[i].x;
+		mCellPositions.y[pos] = points[i].y;
+	}
+}
+
+uint32_t SpatialGrid::cellCoord(double v, float minV, uint32_t numCells) const
+{
+	const double c = std::floor((v - minV) / mCellSize);
+	if (c < 0.0) {
+		return 0;
+	}
+	if (c >= numCells) {
+		return numCells - 1;
+	}
+	return static_cast<uint32_t>(c);
+}
+
+size_t SpatialGrid::getMemoryUsage() const
+{
+	return (mCellStart.capacity() + mCellPoints.capacity()) * sizeof(uint32_t) +
+		(mCellPositions.x.capacity() + mCellPositions.y.capacity()) * sizeof(float);
+}
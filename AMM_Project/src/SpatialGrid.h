@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Model.h"
+#include "DistanceKernels.h"
+#include "BitOps.h"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Uniform grid over a set of points, radius queries only visit the cells
+// overlapping the query circle
+class SpatialGrid
+{
+public:
+	SpatialGrid() = default;
+
+	// cellSize should be close to the usual query radius
+	SpatialGrid(const ArrayView<vec>& points, float cellSize);
+
+	// Calls f(i) for every point i with points[i].dist(center) <= radius
+	template<typename F>
+	void forEachInRadius(const vec& center, float radius, F f) const;
+
+	// Bytes held by the cells
+	size_t getMemoryUsage() const;
+
+private:
+
+	float mMinX = 0.0f;
+	float mMinY = 0.0f;
+	double mCellSize = 1.0;
+	uint32_t mNumCellsX = 0;
+	uint32_t mNumCellsY = 0;
+
+	// points of cell i are in [mCellStart[i], mCellStart[i + 1])
+	std::vector<uint32_t> mCellStart;
+	std::vector<uint32_t> mCellPoints;
+	PointsSoA mCellPositions;
+
+	const DistanceKernels* mKernels = &getDistanceKernels();
+
+	uint32_t cellCoord(double v, float minV, uint32_t numCells) const;
+};
+
+
+template<typename F>
+void SpatialGrid::forEachInRadius(const vec& center, float radius, F f) const
+{
+	if (mCellPoints.empty()) {
+		return;
+	}
+	// small margin so that rounding never leaves out a cell
+	const double r = static_cast<double>(radius) * (1.0 + 1e-5) + 1e-5;
+	const uint32_t x0 = cellCoord(center.x - r, mMinX, mNumCellsX);
+	const uint32_t x1 = cellCoord(center.x + r, mMinX, mNumCellsX);
+	const uint32_t y0 = cellCoord(center.y - r, mMinY, mNumCellsY);
+	const uint32_t y1 = cellCoord(center.y + r, mMinY, mNumCellsY);
+
+	const float r2 = squaredRadius(radius);
+	for (uint32_t y = y0; y <= y1; ++y) {
+		// the cells of a row are contiguous
+		const uint32_t end = mCellStart[y * mNumCellsX + x1 + 1];
+		for (uint32_t i = mCellStart[y * mNumCellsX + x0]; i < end; i += 64) {
+			const uint32_t n = std::min(end - i, 64u);
+			uint64_t mask = mKernels->maskWithin(mCellPositions.x.data() + i, mCellPositions.y.data() + i, n, center.x, center.y, r2);
+			while (mask != 0) {
+				f(mCellPoints[i + lowestBit(mask)]);
+				mask &= mask - 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(int numThreads)
+{
+	numThreads = std::max(1, numThreads);
+	for (int i = 0; i < numThreads; ++i) {
+		mQueues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+	mThreads.reserve(numThreads);
+	for (int i = 0; i < numThreads; ++i) {
+		mThreads.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<size_t>(i));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWork.notify_all();
+	for (std::thread& thread : mThreads) {
+		thread.join();
+	}
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+	{
+		// counted and queued together, a worker never reserves a task that is not queued yet
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending++;
+		mQueued++;
+		Queue& queue = *mQueues[mNextQueue];
+		mNextQueue = (mNextQueue + 1) % mQueues.size();
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	mWork.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [&]() { return mPending == 0; });
+}
+
+bool WorkStealingPool::tryTake(size_t self, std::function<void()>& task)
+{
+	{
+		Queue& own = *mQueues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.front());
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+	for (size_t i = 1; i < mQueues.size(); ++i) {
+		Queue& victim = *mQueues[(self + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.back());
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(size_t self)
+{
+	std::function<void()> task;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWork.wait(lock, [&]() { return mQueued > 0 || mStopping; });
+			if (mQueued == 0) {
+				return;
+			}
+			// reserves one of the queued tasks for this thread
+			mQueued--;
+		}
+		// the reserved task is in some queue, a scan can only miss it while others move
+		while (!tryTake(self, task)) {
+			std::this_thread::yield();
+		}
+
+		task();
+		task = nullptr;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mPending == 0) {
+			mDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads, each with its own queue of tasks. A thread runs the tasks
+// of its queue in submission order and steals from the back of the others when empty
+class WorkStealingPool
+{
+public:
+
+	WorkStealingPool(int numThreads);
+
+	// Waits for the pending tasks
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// Queues are filled round robin, submit longer tasks first for a better balance
+	void submit(std::function<void()> task);
+
+	// Blocks until every submitted task has finished
+	void wait();
+
+	int getNumThreads() const { return static_cast<int>(mThreads.size()); }
+
+private:
+
+	typedef struct Queue
+	{
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+
+	} Queue;
+
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread> mThreads;
+	size_t mNextQueue = 0;
+
+	// tasks submitted and not finished, and the ones no worker reserved yet, guarded by mMutex
+	size_t mPending = 0;
+	size_t mQueued = 0;
+	bool mStopping = false;
+	std::mutex mMutex;
+	std::condition_variable mWork;
+	std::condition_variable mDone;
+
+	bool tryTake(size_t self, std::function<void()>& task);
+
+	void workerLoop(size_t self);
+};
@@ -2,19 +2,216 @@
 
 #include "Model.h"
 #include "GreedyModel.h"
+#include "MultiStartGRASP.h"
+#include "BatchSolver.h"
+#include "SolutionWriter.h"
+#include "Instrumentation.h"
 #include <iostream>
 #include <chrono>
+#include <fstream>
+#include <cstdlib>
+#include <thread>
+#include <sstream>
+
+// Every assignment with -v, otherwise only the cost and the violated constraints
+static void printModel(const GreedyModel& model, bool verbose)
+{
+	if (verbose) {
+		std::cout << model;
+		return;
+	}
+	const SolutionReport report = model.getReport();
+	std::cout << "Resulting cost: " << report.cost << "\n";
+	std::cout << "Is a solution?: " << report.feasible << "\n";
+	if (!report.feasible) {
+		std::cout << report.unassignedCities << " unassigned cities, " << report.sameCenterCities << " with the same center twice, "
+			<< report.invalidAssignments << " invalid assignments, " << report.overloadedCenters << " overloaded centers, "
+			<< report.conflictingCenters << " conflicting centers\n";
+	}
+}
+
+// Comma separated numbers, such as 0.1,0.25,0.5
+static std::vector<float> parseFloatList(const std::string& text)
+{
+	std::vector<float> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		values.push_back(static_cast<float>(std::atof(item.c_str())));
+	}
+	return values;
+}
+
+static void printUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options] [instance.dat | instance.bin]\n"
+		<< "  -t, --threads N        all the cores by default\n"
+		<< "  -s, --seed N           0 by default\n"
+		<< "  -i, --iterations N     cap on the GRASP starts, none by default\n"
+		<< "  --time S               seconds for the run or each batch instance, 600 by default\n"
+		<< "  --target C             stops at a solution of cost C or less\n"
+		<< "  --elite N              elite pool size for path relinking, off by default\n"
+		<< "  --reactive             draws alpha from a learned distribution\n"
+		<< "  --alpha-weights W,...  initial weights of the reactive alphas\n"
+		<< "  --anneal               simulated annealing after GRASP\n"
+		<< "  --solution FILE        writes the solution, JSON if FILE ends with .json\n"
+		<< "  -v, --verbose          prints every assignment\n"
+		<< "  --stats                instrumentation summary on stderr\n"
+		<< "  -c, --convert FILE     only writes the instance in the binary format\n"
+		<< "  -b, --batch PATH       solves every instance of a directory or manifest\n"
+		<< "  -o, --output FILE      batch results, stdout by default\n"
+		<< "  --format csv|json      batch results format, csv by default\n"
+		<< "The instance is data/output.txt by default" << std::endl;
+}
 
 int main(int argc, char* argv[]) {
 
 	Model modelData;
 
 	std::string fileName = "data/output.txt";
-	if (argc == 2) {
-		fileName = argv[1];
+	int numThreads = 0;
+	uint32_t seed = 0;
+	uint64_t maxIterations = 0;
+	double maxSeconds = 600;
+	float targetCost = -std::numeric_limits<float>::infinity();
+	std::string binaryFileName;
+	std::string batchPath;
+	std::string outputFileName;
+	bool json = false;
+	bool verbose = false;
+	std::string solutionFileName;
+	bool stats = false;
+	bool anneal = false;
+	// path relinking with --elite, a run with it depends on the order the starts finish
+	int eliteSize = 0;
+	// alphas drawn by reactive GRASP with --reactive or --alpha-weights
+	const std::vector<float> reactiveAlphas = { 0.0f, 0.05f, 0.1f, 0.15f, 0.2f, 0.3f, 0.4f, 0.5f };
+	bool reactive = false;
+	std::vector<float> alphaWeights;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+			numThreads = std::atoi(argv[++i]);
+		}
+		else if ((arg == "-s" || arg == "--seed") && i + 1 < argc) {
+			seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if ((arg == "-i" || arg == "--iterations") && i + 1 < argc) {
+			maxIterations = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--time" && i + 1 < argc) {
+			maxSeconds = std::atof(argv[++i]);
+		}
+		else if (arg == "--target" && i + 1 < argc) {
+			targetCost = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if ((arg == "-c" || arg == "--convert") && i + 1 < argc) {
+			binaryFileName = argv[++i];
+		}
+		else if ((arg == "-b" || arg == "--batch") && i + 1 < argc) {
+			batchPath = argv[++i];
+		}
+		else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+			outputFileName = argv[++i];
+		}
+		else if (arg == "-v" || arg == "--verbose") {
+			verbose = true;
+		}
+		else if (arg == "--elite" && i + 1 < argc) {
+			eliteSize = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--reactive") {
+			reactive = true;
+		}
+		else if (arg == "--alpha-weights" && i + 1 < argc) {
+			reactive = true;
+			alphaWeights = parseFloatList(argv[++i]);
+			if (alphaWeights.size() != reactiveAlphas.size()) {
+				std::cout << "--alpha-weights needs " << reactiveAlphas.size() << " weights, one per alpha" << std::endl;
+				exit(1);
+			}
+		}
+		else if (arg == "--anneal") {
+			anneal = true;
+		}
+		else if (arg == "--stats") {
+			stats = true;
+		}
+		else if (arg == "--solution" && i + 1 < argc) {
+			solutionFileName = argv[++i];
+		}
+		else if (arg == "--format" && i + 1 < argc) {
+			const std::string format = argv[++i];
+			if (format != "csv" && format != "json") {
+				std::cerr << "Unknown format " << format << ", expected csv or json" << std::endl;
+				exit(1);
+			}
+			json = format == "json";
+		}
+		else if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return 0;
+		}
+		// an unknown option, or one without its value, is not a file name
+		else if (arg.size() > 1 && arg[0] == '-') {
+			std::cout << "Unknown option or missing value: " << arg << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+		else {
+			fileName = arg;
+		}
 	}
+
+	// every instance of a directory or manifest, --time is the budget of each one
+	if (!batchPath.empty()) {
+		BatchOptions options;
+		options.numThreads = numThreads;
+		options.secondsPerInstance = maxSeconds;
+		options.maxIterations = maxIterations;
+		options.targetCost = targetCost;
+		options.seed = seed;
+		options.json = json;
+		options.eliteSize = static_cast<size_t>(eliteSize);
+		if (reactive) {
+			options.reactiveAlphas = reactiveAlphas;
+			options.alphaWeights = alphaWeights;
+		}
+
+		std::ofstream outputFile;
+		if (!outputFileName.empty()) {
+			outputFile.open(outputFileName);
+			if (!outputFile) {
+				std::cout << "Cannot write file " << outputFileName << std::endl;
+				exit(1);
+			}
+		}
+		// errors go to stderr, stdout may hold the results
+		std::vector<std::string> instances;
+		if (!BatchSolver::listInstances(batchPath, instances)) {
+			std::cerr << "Cannot read directory or manifest " << batchPath << std::endl;
+			exit(1);
+		}
+		if (instances.empty()) {
+			std::cerr << "No instances in " << batchPath << std::endl;
+			exit(1);
+		}
+		BatchSolver batch(options, outputFileName.empty() ? std::cout : outputFile);
+		batch.run(instances);
+		if (stats) {
+			Instrumentation::dump(std::cerr);
+		}
+		return 0;
+	}
+
 	auto start = std::chrono::steady_clock::now();
 
+	// the time budget covers the whole execution, loading included
+	SolverLimits limits;
+	limits.deadline = deadlineAfter(start, maxSeconds);
+	limits.maxIterations = maxIterations;
+	limits.targetCost = targetCost;
+
 	bool read = modelData.readFromFile(fileName);
 	if (!read)
 	{
@@ -26,13 +223,29 @@ int main(int argc, char* argv[]) {
 		std::cout << "Model file loaded " << fileName << std::endl;
 	}
 
+	// only convert the instance to the binary format
+	if (!binaryFileName.empty()) {
+		if (!modelData.writeBinary(binaryFileName)) {
+			std::cout << "Cannot write file " << binaryFileName << std::endl;
+			exit(1);
+		}
+		std::cout << "Binary instance written to " << binaryFileName << std::endl;
+		return 0;
+	}
+
 
-	GreedyModel pMod(modelData);
+	// built once, the models of the multi-start phase share it
+	const std::shared_ptr<const ProblemInstance> instance = std::make_shared<const ProblemInstance>(modelData);
+	GreedyModel pMod(instance);
+	if (numThreads > 0) {
+		pMod.setNumThreads(numThreads);
+	}
+	pMod.setDeadline(limits.deadline);
 
 	pMod.runGreedy();
 	auto end = std::chrono::steady_clock::now();
 	auto diff = end - start;
-	std::cout << pMod;
+	printModel(pMod, verbose);
 	std::cout << std::chrono::duration<double>(diff).count() << " seconds for greedy execution" << std::endl;
 	float costGreedy = pMod.getCentersCost();
 	start = std::chrono::steady_clock::now();
@@ -40,45 +253,94 @@ int main(int argc, char* argv[]) {
 	end = std::chrono::steady_clock::now();
 	float costParallel = pMod.getCentersCost();
 	diff = end - start;
-	std::cout << pMod;
+	printModel(pMod, verbose);
 	std::cout << std::chrono::duration <double>(diff).count() << " seconds for local search execution" << std::endl;
 
-	std::cout << costGreedy <<" as cost for Greedy and  " << costParallel << " as cost for localSearch "  << std::endl;
+	start = std::chrono::steady_clock::now();
+	pMod.runNeighbourhoodDescent();
+	end = std::chrono::steady_clock::now();
+	float costDescent = pMod.getCentersCost();
+	diff = end - start;
+	printModel(pMod, verbose);
+	std::cout << std::chrono::duration <double>(diff).count() << " seconds for neighbourhood descent execution" << std::endl;
+
+	std::cout << costGreedy <<" as cost for Greedy and  " << costParallel << " as cost for localSearch and " << costDescent << " as cost for neighbourhood descent" << std::endl;
 
-	float cost = std::numeric_limits<float>::infinity();
-	srand(0);
+	// one replica per thread, each running whole GRASP starts on its own
+	const int numReplicas = numThreads > 0 ? numThreads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	MultiStartGRASP grasp(pMod, numReplicas);
+	// the best solution never gets worse than the one of the descent
+	grasp.setIncumbent(pMod);
+	// without --elite the starts are independent, with -i the result only depends on -s
+	grasp.setPathRelinking(static_cast<size_t>(eliteSize), 4);
+	if (reactive) {
+		grasp.setReactiveAlphas(reactiveAlphas, alphaWeights);
+	}
 	start = std::chrono::steady_clock::now();
-	auto current = std::chrono::steady_clock::now();
-	uint64_t iterations = 0;
-
-	IModel* copy = new IModel(pMod);
-
-	while (std::chrono::duration <double>(current - start).count() <= 600) {
-		iterations++;
-		pMod.purge();
-		pMod.GRASPConstructivePhase(0.2);
-		uint32_t costAux = pMod.getCentersCost();
-		pMod.runParallelLocalSearch();
-		current = std::chrono::steady_clock::now();
-		/*
-		if (pMod.isSolution()) {
-			std::cout << "solution is feasible with ";
+
+	// with --anneal the starts get half of the remaining time and the annealing the rest
+	SolverLimits graspLimits = limits;
+	if (anneal && limits.deadline != std::chrono::steady_clock::time_point::max() && limits.deadline > start) {
+		graspLimits.deadline = start + (limits.deadline - start) / 2;
+	}
+	grasp.run(0.2f, graspLimits, seed, [](const SolverProgress& progress) {
+		std::cout << "GRASP improved to " << progress.cost << " after " << progress.seconds << " seconds in iteration " << progress.iteration << std::endl;
+	});
+	end = std::chrono::steady_clock::now();
+	if (grasp.getBest() != nullptr) {
+		pMod.setSolution(*grasp.getBest());
+	}
+	printModel(pMod, verbose);
+	diff = end - start;
+	std::cout << std::chrono::duration <double>(diff).count() << " seconds for "<< grasp.getIterations() <<" iterations of GRASP execution (" << grasp.getRelinkings() << " path relinkings, " << grasp.getInfeasibleStarts() << " proven infeasible starts) on " << numReplicas << " threads with optimal cost "<< grasp.getBestCost() << std::endl;
+
+	// the probabilities can seed a later run on a similar instance
+	if (reactive) {
+		std::cout << "Alpha distribution learned by reactive GRASP" << std::endl;
+		std::string weights;
+		for (const AlphaStats& alphaStats : grasp.getAlphaStats()) {
+			std::cout << "  alpha " << alphaStats.alpha << ": probability " << alphaStats.probability << ", " << alphaStats.starts << " starts, "
+				<< alphaStats.infeasibleStarts << " infeasible, mean cost " << alphaStats.meanCost << std::endl;
+			weights += (weights.empty() ? "" : ",") + std::to_string(alphaStats.probability);
 		}
-		else {
-			std::cout << "solution is infeasible with ";
+		std::cout << "Seed a later run with --alpha-weights " << weights << std::endl;
+	}
+
+	// from the best GRASP solution until the deadline, the iteration cap is for GRASP
+	if (anneal) {
+		SolverLimits annealLimits = limits;
+		annealLimits.maxIterations = 0;
+		start = std::chrono::steady_clock::now();
+		grasp.runAnnealing(annealLimits, seed, [](const SolverProgress& progress) {
+			std::cout << "Annealing improved to " << progress.cost << " after " << progress.seconds << " seconds in cycle " << progress.iteration << std::endl;
+		});
+		end = std::chrono::steady_clock::now();
+		if (grasp.getBest() != nullptr) {
+			pMod.setSolution(*grasp.getBest());
 		}
-		std::cout << costAux << " cost for constructive phase " << pMod.getCentersCost() <<" cost after local search" <<std::endl;
-		*/
-		if (pMod.isSolution() && cost > pMod.getCentersCost()) {
-			cost = pMod.getCentersCost();
-			delete copy;
-			copy = new IModel(&pMod);
+		printModel(pMod, verbose);
+		diff = end - start;
+		std::cout << std::chrono::duration <double>(diff).count() << " seconds for " << grasp.getIterations() << " cycles of simulated annealing on " << numReplicas << " threads with optimal cost " << grasp.getBestCost() << std::endl;
+	}
+
+	// JSON if the name ends with .json, binary otherwise
+	if (!solutionFileName.empty()) {
+		const bool isJson = solutionFileName.size() >= 5 && solutionFileName.compare(solutionFileName.size() - 5, 5, ".json") == 0;
+		const SolutionReport report = pMod.getReport();
+		const bool written = isJson ?
+			writeSolutionJson(solutionFileName, modelData, pMod.getSolution(), report) :
+			writeSolutionBinary(solutionFileName, pMod.getSolution(), report);
+		if (!written) {
+			std::cout << "Cannot write file " << solutionFileName << std::endl;
+			exit(1);
 		}
+		std::cout << "Solution written to " << solutionFileName << std::endl;
+	}
+
+	// the counters of every thread, on stderr to keep the solver output unchanged
+	if (stats) {
+		Instrumentation::dump(std::cerr);
 	}
-	std::cout << *copy;
-	end = std::chrono::steady_clock::now();
-	diff = end - start;
-	std::cout << std::chrono::duration <double>(diff).count() << " seconds for "<< iterations <<" iterations of GRASP execution with optimal cost "<< cost << std::endl;
 
 	return 0;
 }